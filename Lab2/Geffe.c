@@ -19,12 +19,14 @@ void Geffe(buffer_t *output, buffer_t *s1, buffer_t *s2, buffer_t *s3){
 	uchar *pt_s2 = s2->tab;
 	uchar *pt_s3 = s3->tab;
 
-	uchar tmp;
-	// Do the operation in bytes
-	for (int i=0; i<s1->length; i++){
-        tmp = ((pt_s1[i] & pt_s2[i]) ^ (pt_s2[i] & pt_s3[i])) ^ pt_s3[i];
-        buffer_append_uchar(output, tmp);
-    }
+	// Do the operation in bytes, straight into output
+	size_t start = output->length;
+	if(buffer_resize(output, start + s1->length) == 0)
+		return;
+	uchar *pt_out = output->tab + start;
+	for (int i=0; i<s1->length; i++)
+        pt_out[i] = ((pt_s1[i] & pt_s2[i]) ^ (pt_s2[i] & pt_s3[i])) ^ pt_s3[i];
+	output->length = start + s1->length;
 
 }
 
@@ -37,14 +39,10 @@ double correlation(buffer_t *s1, buffer_t *s2){
 	double equal = 0;
 	double cnt = 0;
 
-	// Calculate bit by bit
+	// Calculate byte by byte : the bits that differ are the ones of the xor
 	for (int i=0; i<s1->length; i++){
-		for (int j=0; j<8; j++){
-			cnt += 1;
-			if(getBit(pt_s1[i],j) ==  getBit(pt_s2[i],j))
-				equal += 1;
-		}
-		
+		cnt += 8;
+		equal += 8 - HammingWeightByte(pt_s1[i] ^ pt_s2[i]);
 	}
 
 	double correlation = equal / cnt;
@@ -83,7 +81,9 @@ void positions(buffer_t *output, buffer_t *s1, buffer_t *s3){
 /* to be filled in */
 	uchar *pt_s1 = s1->tab;
 	uchar *pt_s3 = s3->tab;
-	//uchar *pt_output = output->tab;
+	if(buffer_resize(output, s1->length) == 0)
+		return;
+	uchar *pt_output = output->tab;
 	int shift;
 	uchar t;
 
@@ -97,7 +97,7 @@ void positions(buffer_t *output, buffer_t *s1, buffer_t *s3){
 				t = t & (~shift); 	
 			}
 		}	
-		buffer_append_uchar(output, t);
+		pt_output[i] = t;
 	}
 	output->length = s1->length;
 }
@@ -89,22 +89,18 @@ uchar setBit(uchar t, int position, uchar value){
 
 int HammingWeightByte(uchar c){
 /* to be filled in */
-    int cnt = 0;
-    for (int i=0; i<8; i++){
-        cnt += getBit(c,i);
-    }
-    return cnt;
+    // Bits summed by pairs, then nibbles
+    c = c - ((c >> 1) & 0x55);
+    c = (c & 0x33) + ((c >> 2) & 0x33);
+    return (c + (c >> 4)) & 0x0f;
 }
 
 
 int HammingWeight(buffer_t *buf){
 /* to be filled in */
     int cnt = 0;
-    for (int i=0; i< buf->length; i++){
-        for (int j=0; j<8; j++){
-            cnt += getBit(buf->tab[i],j);
-        }
-    }
+    for (int i=0; i< buf->length; i++)
+        cnt += HammingWeightByte(buf->tab[i]);
     return cnt;
 }
 
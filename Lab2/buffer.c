@@ -107,9 +107,11 @@ int buffer_append_uchar(buffer_t *buf, uchar c){
 }
 
 
-/*! \brief Reset buffer to 0 */
+/*! \brief Reset buffer to 0. Only the bytes in use are cleared, so that
+  the cost does not depend on how large \a buf once grew. */
 void buffer_reset(buffer_t *buf){
-    memset(buf->tab, 0, buf->size);
+    if(buf->length > 0)
+	memset(buf->tab, 0, buf->length);
     buf->length = 0;	
 }
 
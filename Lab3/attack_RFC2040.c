@@ -7,6 +7,7 @@ Last modification : October 8, 2018
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "gmp.h"
 #include "buffer.h"
 #include "sha3.h"
 #include "aes.h"
@@ -19,46 +20,43 @@ Last modification : October 8, 2018
 //   RFC2040 
 //   Else return 0.
 //   If the cipher text has not the good length, returns -1. 
-int oracle(buffer_t *encrypted, buffer_t *key){
+int oracle(buffer_t *encrypted, aes_ctx_t *ctx){
     if(encrypted->length % BLOCK_LENGTH != 0){
 	perror("[oracle] ERROR : cipher text has not a valid length.\n");
 	return -1;
     }
 
-    buffer_t decrypted;
-    buffer_init(&decrypted, encrypted->length - BLOCK_LENGTH);	
-    aes_raw_CBC_decrypt(&decrypted, encrypted, key);
-	
-    uchar *cursor = decrypted.tab + decrypted.length - 1;
-    uchar a = *cursor;
-    if(a == 0 || a > BLOCK_LENGTH){
-	buffer_clear(&decrypted);
+    if(encrypted->length < 2 * BLOCK_LENGTH)
 	return 0;
-    }
-    cursor--;
-    int result = 1;
 
-    for(int i = 1; i < a; i++, cursor--){
-	if(*cursor != a){
-	    result = 0;
-	    break;
-	}
-    }
-	
-    buffer_clear(&decrypted);
-    return result;
+    // Only the last block holds the padding : decrypt it alone
+    // and xor it with the previous encrypted block.
+    uchar last[BLOCK_LENGTH];
+    uchar *previous = encrypted->tab + encrypted->length - 2 * BLOCK_LENGTH;
+    aes_decrypt_blocks(ctx, last, previous + BLOCK_LENGTH, 1);
+    for(int i = 0; i < BLOCK_LENGTH; i++)
+	last[i] ^= previous[i];
+
+    uchar a = last[BLOCK_LENGTH - 1];
+    if(a == 0 || a > BLOCK_LENGTH)
+	return 0;
+
+    for(int i = 1; i < a; i++)
+	if(last[BLOCK_LENGTH - 1 - i] != a)
+	    return 0;
+    return 1;
 }
 
 
 /* Returns the position of the first byte of padding */
 /* in the last block of the encrypted_text           */
-int get_padding_position(buffer_t *encrypted, buffer_t *key){
+int get_padding_position(buffer_t *encrypted, aes_ctx_t *ctx){
     if(encrypted->length % BLOCK_LENGTH != 0 ||
        encrypted->length / BLOCK_LENGTH < 2){
 	perror("[get_padding_position] ERROR : cipher text has not a valid length.\n");
 	return -1;
     }
-    if(!oracle(encrypted, key)){
+    if(!oracle(encrypted, ctx)){
 	perror("[get_padding_position] ERROR : input is not a valid ciphertext.\n");
 	return -1;
     }
@@ -68,16 +66,16 @@ int get_padding_position(buffer_t *encrypted, buffer_t *key){
     buffer_t tmp_encrypted; // create a tmp buffer to store the value of encrypted
     buffer_init(&tmp_encrypted, encrypted->length);
 
-    for(int j = 0; j < encrypted->length; j++)
-		buffer_append_uchar(&tmp_encrypted, encrypted->tab[j]);//  copy the encrypted to the tmp buffer
+    buffer_append_bytes(&tmp_encrypted, encrypted->tab, encrypted->length);//  copy the encrypted to the tmp buffer
 
     for (int i=0; i<encrypted->length; i++){
         tmp_encrypted.tab[i] = encrypted->tab[i] ^ 1;
-        if(!oracle(&tmp_encrypted, key)){
+        if(!oracle(&tmp_encrypted, ctx)){
             first_padding = i;
             break;
         }
     }
+    buffer_clear(&tmp_encrypted);
 
 /* to be filled in */
     return first_padding%16; // each element has 16 bytes
@@ -131,7 +129,7 @@ int prepare(buffer_t *corrupted, buffer_t *encrypted, buffer_t *decrypted,
 
 
 
-int find_last_byte(uchar *hack, buffer_t *corrupted, int position, buffer_t *key){
+int find_last_byte(uchar *hack, buffer_t *corrupted, int position, aes_ctx_t *ctx){
     if(corrupted->length < 2 * BLOCK_LENGTH){
 	perror("[find_last_byte] ERROR : cipher_text is too short.\n");
 	*hack = 0;
@@ -148,7 +146,7 @@ int find_last_byte(uchar *hack, buffer_t *corrupted, int position, buffer_t *key
 
 	for (int i=0; i<256; i++){ // Max is 256
 		corrupted->tab[position - BLOCK_LENGTH] = tmp ^ (*hack);
-		if(oracle(corrupted, key)){
+		if(oracle(corrupted, ctx)){
             break;
         }
 		(*hack)++;
@@ -159,9 +157,9 @@ int find_last_byte(uchar *hack, buffer_t *corrupted, int position, buffer_t *key
 }
 
 
-int full_attack(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key) {
+int full_attack(buffer_t *decrypted, buffer_t *encrypted, aes_ctx_t *ctx) {
 
-	 int pad_position = get_padding_position(encrypted, key);
+	 int pad_position = get_padding_position(encrypted, ctx);
 	
 	 uchar pad_value = BLOCK_LENGTH - pad_position;
 	 decrypted->length = encrypted->length - BLOCK_LENGTH;
@@ -179,7 +177,7 @@ int full_attack(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key) {
 
 	for(int i = pad_block; i >= pad_block - 54; i--){
 		prepare(&corrupted, encrypted, decrypted, i);
-		find_last_byte(&temp_last_v, &corrupted, i-1, key);
+		find_last_byte(&temp_last_v, &corrupted, i-1, ctx);
         printf("--------------temp_last_v:%d\n",temp_last_v);
 		decrypted->tab[i-16] = temp_last_v ;
 	}
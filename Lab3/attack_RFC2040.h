@@ -1,6 +1,6 @@
-int oracle(buffer_t *encrypted, buffer_t *key);
-int get_padding_position(buffer_t *encrypted, buffer_t *key);
+int oracle(buffer_t *encrypted, aes_ctx_t *ctx);
+int get_padding_position(buffer_t *encrypted, aes_ctx_t *ctx);
 int prepare(buffer_t *corrupted, buffer_t *encrypted, buffer_t *decrypted,
 			 int known_positions);
-int find_last_byte(uchar *hack, buffer_t *corrupted, int pad_position, buffer_t *key);
-int full_attack(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key);
+int find_last_byte(uchar *hack, buffer_t *corrupted, int pad_position, aes_ctx_t *ctx);
+int full_attack(buffer_t *decrypted, buffer_t *encrypted, aes_ctx_t *ctx);
@@ -0,0 +1,203 @@
+/**************************************************************/
+/* avalanche.c                                                */
+/* Strict avalanche criterion of AES-128 : Monte-Carlo        */
+/* estimate of the 128 x 128 matrix of flip probabilities     */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "gmp.h"
+#include "buffer.h"
+#include "parallel.h"
+#include "aes.h"
+#include "drbg.h"
+#include "avalanche.h"
+
+/* Samples of one thread, counted apart and summed at the end */
+typedef struct{
+    int mode;
+    long nr_samples;
+    uint64_t seed;
+    uint32_t *count; /* SAC_BITS x SAC_BITS flips */
+} shard_t;
+
+
+/* SplitMix64, one state per thread */
+static uint64_t sac_next(uint64_t *state){
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+static void sac_random(uint64_t *state, uchar block[]){
+    uint64_t x = sac_next(state), y = sac_next(state);
+    memcpy(block, &x, 8);
+    memcpy(block + 8, &y, 8);
+}
+
+
+/* Bits 64 * w to 64 * w + 63 of a xor b, bit i being bit i % 8 of byte i / 8 */
+static uint64_t xor_word(uchar a[], uchar b[], int w){
+    uint64_t x = 0;
+    for(int k = 7; k >= 0; k--)
+	x = (x << 8) | (uchar)(a[8 * w + k] ^ b[8 * w + k]);
+    return x;
+}
+
+
+/* row[j]++ for each output bit j that differs between a and b */
+static void sac_count(uint32_t row[], uchar a[], uchar b[]){
+    for(int w = 0; w < 2; w++){
+	uint64_t x = xor_word(a, b, w);
+	while(x){
+	    row[64 * w + __builtin_ctzll(x)]++;
+	    x &= x - 1;
+	}
+    }
+}
+
+
+/* Message bits : the reference block and its SAC_BITS neighbours are
+   encrypted in a single batch under the same key */
+static void sac_msg_samples(shard_t *shard){
+    uchar in[(SAC_BITS + 1) * BLOCK_LENGTH], out[(SAC_BITS + 1) * BLOCK_LENGTH];
+    buffer_t key;
+    aes_ctx_t ctx;
+    buffer_init(&key, BLOCK_LENGTH);
+    key.length = BLOCK_LENGTH;
+
+    for(long s = 0; s < shard->nr_samples; s++){
+	sac_random(&shard->seed, key.tab);
+	aes_ctx_init(&ctx, &key);
+	sac_random(&shard->seed, in);
+	for(int i = 0; i < SAC_BITS; i++){
+	    uchar *flipped = in + (i + 1) * BLOCK_LENGTH;
+	    memcpy(flipped, in, BLOCK_LENGTH);
+	    flipped[i / 8] ^= 1 << (i % 8);
+	}
+	aes_encrypt_blocks(&ctx, out, in, SAC_BITS + 1);
+	for(int i = 0; i < SAC_BITS; i++)
+	    sac_count(shard->count + SAC_BITS * i, out, out + (i + 1) * BLOCK_LENGTH);
+    }
+    aes_ctx_clear(&ctx);
+    buffer_clear(&key);
+}
+
+
+/* Key bits : one key schedule per flipped bit cannot be avoided */
+static void sac_key_samples(shard_t *shard){
+    uchar msg[BLOCK_LENGTH], encrypted[BLOCK_LENGTH], encrypted2[BLOCK_LENGTH];
+    buffer_t key;
+    aes_ctx_t ctx;
+    buffer_init(&key, BLOCK_LENGTH);
+    key.length = BLOCK_LENGTH;
+
+    for(long s = 0; s < shard->nr_samples; s++){
+	sac_random(&shard->seed, key.tab);
+	sac_random(&shard->seed, msg);
+	aes_ctx_init(&ctx, &key);
+	aes_ctx_encrypt(&ctx, encrypted, msg);
+	for(int i = 0; i < SAC_BITS; i++){
+	    key.tab[i / 8] ^= 1 << (i % 8);
+	    aes_ctx_init(&ctx, &key);
+	    aes_ctx_encrypt(&ctx, encrypted2, msg);
+	    key.tab[i / 8] ^= 1 << (i % 8);
+	    sac_count(shard->count + SAC_BITS * i, encrypted, encrypted2);
+	}
+    }
+    aes_ctx_clear(&ctx);
+    buffer_clear(&key);
+}
+
+
+static void *sac_shard(void *arg){
+    shard_t *shard = (shard_t *)arg;
+    if(shard->mode == SAC_KEY)
+	sac_key_samples(shard);
+    else
+	sac_msg_samples(shard);
+    return NULL;
+}
+
+
+int avalanche_sac(double sac[], int mode, long nr_samples){
+    if(nr_samples <= 0){
+	perror("[avalanche_sac] : The number of samples should be positive.\n");
+	return 0;
+    }
+    int nr_threads = parallel_nr_threads();
+    if(nr_threads > nr_samples)
+	nr_threads = (int)nr_samples;
+
+    // 1. One shard of samples per thread, each with its own generator
+    shard_t shard[PARALLEL_MAX_THREADS];
+    uint32_t *count = calloc((size_t)nr_threads * SAC_BITS * SAC_BITS,
+			     sizeof(uint32_t));
+    if(count == NULL){
+	perror("[avalanche_sac] : Not enough memory.\n");
+	return 0;
+    }
+    uint64_t seed = drbg_u64();
+    int t;
+    for(t = 0; t < nr_threads; t++){
+	shard[t].mode = mode;
+	shard[t].nr_samples = nr_samples / nr_threads
+	    + (t < nr_samples % nr_threads);
+	uint64_t start = seed + (uint64_t)t;
+	shard[t].seed = sac_next(&start);
+	shard[t].count = count + (size_t)t * SAC_BITS * SAC_BITS;
+    }
+
+    // 2. Run them
+    parallel_run(sac_shard, shard, sizeof(shard_t), nr_threads);
+
+    // 3. Sum up the shards
+    for(int c = 0; c < SAC_BITS * SAC_BITS; c++){
+	long flips = 0;
+	for(t = 0; t < nr_threads; t++)
+	    flips += count[(size_t)t * SAC_BITS * SAC_BITS + c];
+	sac[c] = (double)flips / nr_samples;
+    }
+    free(count);
+    return 1;
+}
+
+
+/* Each cell is a binomial count of parameter 1/2 : one degree of freedom
+   per cell, SAC_BITS * SAC_BITS in all */
+double avalanche_chi2(double sac[], long nr_samples){
+    double chi2 = 0;
+    for(int c = 0; c < SAC_BITS * SAC_BITS; c++)
+	chi2 += 4 * nr_samples * (sac[c] - 0.5) * (sac[c] - 0.5);
+    return chi2;
+}
+
+
+/* One row per input bit, comment lines start with # */
+void avalanche_print(FILE *out, double sac[], int mode, long nr_samples){
+    int dof = SAC_BITS * SAC_BITS;
+    double chi2 = avalanche_chi2(sac, nr_samples), mean = 0, worst = 0;
+    for(int c = 0; c < dof; c++){
+	mean += sac[c];
+	if(fabs(sac[c] - 0.5) > worst)
+	    worst = fabs(sac[c] - 0.5);
+    }
+    mean /= dof;
+
+    fprintf(out, "# sac %s %d %d %ld\n", mode == SAC_KEY ? "key" : "msg",
+	    SAC_BITS, SAC_BITS, nr_samples);
+    for(int i = 0; i < SAC_BITS; i++){
+	for(int j = 0; j < SAC_BITS; j++)
+	    fprintf(out, j ? " %.4f" : "%.4f", sac[SAC_BITS * i + j]);
+	fprintf(out, "\n");
+    }
+    fprintf(out, "# mean %f\n", mean);
+    fprintf(out, "# worst %f\n", worst);
+    fprintf(out, "# chi2 %f dof %d z %f\n", chi2, dof,
+	    (chi2 - dof) / sqrt(2.0 * dof));
+}
@@ -0,0 +1,22 @@
+/**************************************************************/
+/* avalanche.h                                                */
+/* Strict avalanche criterion of AES-128                      */
+/**************************************************************/
+
+#ifndef __FRS__AVALANCHE
+
+#define SAC_BITS (8 * BLOCK_LENGTH)
+
+/* Which input bit is flipped */
+#define SAC_MSG 0
+#define SAC_KEY 1
+
+/* sac[SAC_BITS * i + j] : probability that output bit j flips when input
+   bit i does. Bit i is bit i % 8 of byte i / 8, as in buffer_flip_bit().
+   The samples are shared between parallel_nr_threads() threads. */
+int avalanche_sac(double sac[], int mode, long nr_samples);
+double avalanche_chi2(double sac[], long nr_samples);
+void avalanche_print(FILE *out, double sac[], int mode, long nr_samples);
+
+#define __FRS__AVALANCHE
+#endif
@@ -7,9 +7,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "gmp.h"
 #include "random.h"
 #include "hashtable.h"
 #include "easyhash.h"
+#include "drbg.h"
 #include "collisions.h"
 
 int find_collisions(int imax){
@@ -30,6 +32,7 @@ int find_collisions(int imax){
     for (long i=0; i<imax; i++){
         buffer_random(&buf, 4);
         //*(tab + i) = buf;
+        buffer_init(tab+i, 4);
         buffer_clone(tab+i, &buf);
         k = easy_hash(&buf);
         if(hash_get(&kv, H, k) == HASH_FOUND){
@@ -42,6 +45,8 @@ int find_collisions(int imax){
 /* to be filled in */
     buffer_clear(&buf);
     hash_clear(H);
+    for (long i=0; i<imax; i++)
+        buffer_clear(tab+i);
     free (tab);
     return status;
 }
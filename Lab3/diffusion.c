@@ -8,10 +8,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "gmp.h"
 #include "buffer.h"
+#include "arena.h"
 #include "random.h"
 #include "bits.h"
 #include "aes.h"
+#include "drbg.h"
 #include "diffusion.h"
 
 
@@ -19,29 +23,31 @@ double diffusion_test_for_key(buffer_t *key, int nr_tests){
     int length = key->length;
     double result = 0;
     // 1. Intialisation
-    buffer_t msg, key2, encrypted, encrypted2;
-    buffer_init(&msg, length);
-    buffer_init(&key2, length);
-    buffer_init(&encrypted, length);
-    buffer_init(&encrypted2, length);
+    buffer_t msg, key2;
+    uchar encrypted[BLOCK_LENGTH], encrypted2[BLOCK_LENGTH];
+    arena_mark_t mark = arena_mark();
+    buffer_init_scratch(&msg, length);
+    buffer_init_scratch(&key2, length);
+    aes_ctx_t ctx, ctx2;
+    aes_ctx_init(&ctx, key);
 
     // Complete the function
 
     for(int i=0; i<nr_tests; i++){
         buffer_random(&msg, length);
-        aes_block_encrypt(&encrypted, &msg, key);
+        aes_encrypt_blocks(&ctx, encrypted, msg.tab, 1);
         int position = rand() % (length * 8); // [0, L(bits)]
         buffer_flip_bit(&key2, key, position); 
-        aes_block_encrypt(&encrypted2, &msg, &key2);
-        result += HammingDistance(&encrypted, &encrypted2); 
+        aes_ctx_init(&ctx2, &key2);
+        aes_encrypt_blocks(&ctx2, encrypted2, msg.tab, 1);
+        result += HammingDistanceBytes(encrypted, encrypted2, BLOCK_LENGTH);
     }
 
 /* to be filled in */
     // 3. Free memory
-    buffer_clear(&msg);
-    buffer_clear(&key2);	
-    buffer_clear(&encrypted);	
-    buffer_clear(&encrypted2);	
+    aes_ctx_clear(&ctx);
+    aes_ctx_clear(&ctx2);
+    arena_release(mark);
     return result / nr_tests;
 }
 
@@ -50,57 +56,97 @@ double diffusion_test_for_msg(buffer_t *msg, int nr_tests){
     int length = msg->length;
     double result = 0;
     // 1. Intialisation
-    buffer_t key, msg2, encrypted, encrypted2;
-    buffer_init(&key, length);
-    buffer_init(&msg2, length);
-    buffer_init(&encrypted, length);
-    buffer_init(&encrypted2, length);
+    // Both messages go through AES in one call : pair = msg || msg2
+    buffer_t key, msg2;
+    uchar pair[2 * BLOCK_LENGTH], encrypted[2 * BLOCK_LENGTH];
+    arena_mark_t mark = arena_mark();
+    buffer_init_scratch(&key, length);
+    buffer_init_scratch(&msg2, length);
+    memcpy(pair, msg->tab, BLOCK_LENGTH);
+    aes_ctx_t ctx;
     // Complete the function
 
     for(int i=0; i<nr_tests; i++){
         buffer_random(&key, length);
-        aes_block_encrypt(&encrypted, msg, &key);
+        aes_ctx_init(&ctx, &key);
         int position = rand() % (length * 8); // [0, L(bits)]
         buffer_flip_bit(&msg2, msg, position); 
-        aes_block_encrypt(&encrypted2, &msg2, &key);
-        result += HammingDistance(&encrypted, &encrypted2); 
+        memcpy(pair + BLOCK_LENGTH, msg2.tab, BLOCK_LENGTH);
+        aes_encrypt_blocks(&ctx, encrypted, pair, 2);
+        result += HammingDistanceBytes(encrypted, encrypted + BLOCK_LENGTH,
+                                       BLOCK_LENGTH);
     }
 
 /* to be filled in */
-    buffer_clear(&key);
-    buffer_clear(&msg2);	
-    buffer_clear(&encrypted);	
-    buffer_clear(&encrypted2);	
+    aes_ctx_clear(&ctx);
+    arena_release(mark);
     return result / nr_tests;
 }
 
 
+int diffusion_test_rounds(buffer_t *msg, int key_length, int nr_tests,
+			  double result[]){
+    int length = msg->length;
+    // 1. Intialisation
+    // One tapped encryption per message gives the states after every round
+    buffer_t key, msg2;
+    uchar states[AES_MAX_ROUNDS * BLOCK_LENGTH];
+    uchar states2[AES_MAX_ROUNDS * BLOCK_LENGTH];
+    arena_mark_t mark = arena_mark();
+    buffer_init_scratch(&key, key_length);
+    buffer_init_scratch(&msg2, length);
+    aes_ctx_t ctx;
+    int Nr = key_length / 4 + 6;
+    for(int r = 0; r < Nr; r++)
+        result[r] = 0;
+
+    for(int i=0; i<nr_tests; i++){
+        buffer_random(&key, key_length);
+        aes_ctx_init(&ctx, &key);
+        aes_ctx_encrypt_rounds(&ctx, states, msg->tab);
+        int position = rand() % (length * 8); // [0, L(bits)]
+        buffer_flip_bit(&msg2, msg, position); 
+        aes_ctx_encrypt_rounds(&ctx, states2, msg2.tab);
+        for(int r = 0; r < Nr; r++)
+            result[r] += HammingDistanceBytes(states + r * BLOCK_LENGTH,
+                                              states2 + r * BLOCK_LENGTH,
+                                              BLOCK_LENGTH);
+    }
+
+    aes_ctx_clear(&ctx);
+    arena_release(mark);
+    for(int r = 0; r < Nr; r++)
+        result[r] /= nr_tests;
+    return Nr;
+}
+
+
 double diffusion_test_nr_rounds(buffer_t *msg, int Nr, int nr_tests){
     int length = msg->length;
     double result = 0;
     // 1. Intialisation
     buffer_t key, msg2, encrypted, encrypted2;
-    buffer_init(&key, length);
-    buffer_init(&msg2, length);
-    buffer_init(&encrypted, length);
-    buffer_init(&encrypted2, length);
+    arena_mark_t mark = arena_mark();
+    buffer_init_scratch(&key, length);
+    buffer_init_scratch(&msg2, length);
+    buffer_init_scratch(&encrypted, length);
+    buffer_init_scratch(&encrypted2, length);
+    aes_ctx_t ctx;
     // Complete the function
 
     for(int i=0; i<nr_tests; i++){
         buffer_random(&key, length);
-        aes_block_encrypt_few_rounds (&encrypted, msg, &key, Nr);
+        aes_ctx_init(&ctx, &key);
+        aes_block_encrypt_few_rounds_ctx(&encrypted, msg, &ctx, Nr);
         int position = rand() % (length * 8); // [0, L(bits)]
         buffer_flip_bit(&msg2, msg, position); 
-        aes_block_encrypt_few_rounds(&encrypted2, &msg2, &key, Nr);
-        result += HammingDistance(&encrypted, &encrypted2); 
+        aes_block_encrypt_few_rounds_ctx(&encrypted2, &msg2, &ctx, Nr);
+        result += HammingDistanceBytes(encrypted.tab, encrypted2.tab,
+                                       BLOCK_LENGTH);
+        aes_ctx_clear(&ctx);
     }
 
 /* to be filled in */
-    buffer_clear(&key);
-    buffer_clear(&msg2);	
-    buffer_clear(&encrypted);	
-    buffer_clear(&encrypted2);	
-
-/* to be filled in */
+    arena_release(mark);
     return result / nr_tests;
 }
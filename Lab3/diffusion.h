@@ -7,4 +7,9 @@
 
 double diffusion_test_for_key(buffer_t *key, int nr_tests);
 double diffusion_test_for_msg(buffer_t *msg, int nr_tests);
+/* Cipher reduced to Nr rounds, see aes_block_encrypt_few_rounds() */
 double diffusion_test_nr_rounds(buffer_t *msg, int Nr, int nr_tests);
+/* Full cipher with keys of key_length bytes (16, 24 or 32), state after
+   each round r = 1..Nr in result[r - 1]; returns Nr */
+int diffusion_test_rounds(buffer_t *msg, int key_length, int nr_tests,
+			  double result[]);
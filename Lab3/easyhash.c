@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <limits.h>
 
+#include "gmp.h"
 #include "buffer.h"
 #include "hashtable.h"
 #include "easyhash.h"
@@ -7,8 +7,11 @@ Last modification October 9, 2018
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
+#include "gmp.h"
 #include "collisions.h"
+#include "drbg.h"
 
 int main(int argc, char *argv[]){
     int r = 421; /* force default */
@@ -19,6 +22,7 @@ int main(int argc, char *argv[]){
     if(argc > 2)
 	r = atoi(argv[2]);
     srand(r);
+    drbg_seed_ui(r);
     int status = find_collisions(atoi(argv[1]));
     if(status == -42){
 	printf("Function find_collisions was not completed\n");
@@ -7,11 +7,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "gmp.h"
+#include "utilities.h"
 #include "buffer.h"
 #include "random.h"
 #include "bits.h"
+#include "parallel.h"
 #include "aes.h"
+#include "operating_modes.h"
+#include "drbg.h"
 #include "diffusion.h"
+#include "avalanche.h"
 
 void test_aes(){
 	// 1. Initialisation
@@ -112,8 +119,400 @@ void test_diffusion_few_rounds(){
 }
 
 
+void test_aes_speed(){
+    // 1. Initialisation
+    int nr_blocks = 1 << 16, nr_runs = 8;
+    buffer_t key, data;
+    buffer_init(&key, BLOCK_LENGTH);
+    buffer_init(&data, nr_blocks * BLOCK_LENGTH);
+    aes_key_generation(&key, BLOCK_LENGTH);
+    buffer_random(&data, nr_blocks * BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
+    unsigned long long best_enc = -1, best_dec = -1, t;
+
+    // 2. Encrypt and decrypt the whole buffer in place, keep the best run
+    for(int run = 0; run < nr_runs; run++){
+	t = ticks();
+	for(int i = 0; i < nr_blocks; i++)
+	    aes_ctx_encrypt(&ctx, data.tab + i * BLOCK_LENGTH,
+			    data.tab + i * BLOCK_LENGTH);
+	t = ticks() - t;
+	if(t < best_enc)
+	    best_enc = t;
+	t = ticks();
+	for(int i = 0; i < nr_blocks; i++)
+	    aes_ctx_decrypt(&ctx, data.tab + i * BLOCK_LENGTH,
+			    data.tab + i * BLOCK_LENGTH);
+	t = ticks() - t;
+	if(t < best_dec)
+	    best_dec = t;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    printf("AES-128 engine %s, cycles per byte :\n", aes_engine());
+#else
+    printf("AES-128 engine %s, clock ticks per byte :\n", aes_engine());
+#endif
+    printf("encryption : %.2f\n", (double)best_enc / data.length);
+    printf("decryption : %.2f\n\n", (double)best_dec / data.length);
+
+    // 3. Free memory
+    aes_ctx_clear(&ctx);
+    buffer_clear(&key);
+    buffer_clear(&data);
+}
+
+
+void test_aes_CTR(){
+    // 1. Initialisation
+    int length = 1 << 22;
+    buffer_t key, IV, plain, encrypted, decrypted, reference;
+    buffer_init(&key, BLOCK_LENGTH);
+    buffer_init(&IV, BLOCK_LENGTH);
+    buffer_init(&plain, length);
+    buffer_init(&encrypted, length);
+    buffer_init(&decrypted, length);
+    buffer_init(&reference, length);
+    aes_key_generation(&key, BLOCK_LENGTH);
+    buffer_random(&IV, BLOCK_LENGTH);
+    buffer_random(&plain, length - 5);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
+
+    // 2. Same keystream whatever the number of threads
+    parallel_set_threads(1);
+    aes_raw_CTR_ctx(&reference, &plain, &ctx, &IV);
+    for(int nr_threads = 1; nr_threads <= 8; nr_threads *= 2){
+	parallel_set_threads(nr_threads);
+	unsigned long long t = ticks();
+	aes_raw_CTR_ctx(&encrypted, &plain, &ctx, &IV);
+	t = ticks() - t;
+	printf("CTR with %d thread(s) : %.2f per byte ", nr_threads,
+	       (double)t / plain.length);
+	if(buffer_equality(&encrypted, &reference))
+	    printf("[OK]\n");
+	else
+	    printf("[FAILED]\n");
+    }
+    parallel_set_threads(0);
+
+    // 3. Encryption with integrity check, then decryption
+    printf("CTR encryption and decryption ");
+    aes_CTR_encrypt(&encrypted, &plain, &key, &IV);
+    if(aes_CTR_decrypt(&decrypted, &encrypted, &key)
+       && buffer_equality(&decrypted, &plain))
+	printf("[OK]\n\n");
+    else
+	printf("[FAILED]\n\n");
+
+    // 4. Free memory
+    aes_ctx_clear(&ctx);
+    buffer_clear(&key);
+    buffer_clear(&IV);
+    buffer_clear(&plain);
+    buffer_clear(&encrypted);
+    buffer_clear(&decrypted);
+    buffer_clear(&reference);
+}
+
+
+/* Feeds in to a CBC stream in updates of random sizes (0 included),
+   appends everything the stream gives to out. Returns the status of
+   the final call. */
+static int CBC_stream_random_updates(aes_cbc_stream_t *st, buffer_t *out,
+				     buffer_t *in, int decrypt){
+    buffer_t chunk;
+    size_t done, n;
+    int ok = 1;
+    buffer_init(&chunk, BLOCK_LENGTH);
+    for(done = 0; done < in->length; done += n){
+	n = rand() % 100;
+	if(n > in->length - done)
+	    n = in->length - done;
+	ok = ok && (decrypt ?
+		    aes_CBC_decrypt_update(st, &chunk, in->tab + done, n) :
+		    aes_CBC_encrypt_update(st, &chunk, in->tab + done, n));
+	buffer_append(out, &chunk);
+    }
+    ok = (decrypt ? aes_CBC_decrypt_final(st, &chunk) :
+	  aes_CBC_encrypt_final(st, &chunk)) && ok;
+    buffer_append(out, &chunk);
+    buffer_clear(&chunk);
+    return ok;
+}
+
+
+void test_aes_CBC_stream(){
+    // 1. Initialisation
+    int nr_tests = 200;
+    char modes[2] = {'s', 'R'};
+    buffer_t key, IV, plain, reference, streamed, decrypted, raw;
+    buffer_init(&key, BLOCK_LENGTH);
+    buffer_init(&IV, BLOCK_LENGTH);
+    buffer_init(&plain, 1);
+    buffer_init(&reference, 1);
+    buffer_init(&streamed, 1);
+    buffer_init(&decrypted, 1);
+    buffer_init(&raw, 1);
+    aes_key_generation(&key, BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
+    aes_cbc_stream_t st;
+
+    for(int m = 0; m < 2; m++){
+	int ok = 1;
+	for(int i = 0; i < nr_tests && ok; i++){
+	    // lengths 0 to 40 first, around the block boundaries
+	    size_t length = i <= 40 ? i : rand() % 5000;
+	    buffer_random(&IV, BLOCK_LENGTH);
+	    buffer_random(&plain, length);
+	    aes_CBC_encrypt(&reference, &plain, &key, &IV, modes[m]);
+
+	    // 2. Streamed encryption = one-shot encryption, byte for byte
+	    aes_CBC_encrypt_init(&st, &streamed, &key, &IV, modes[m]);
+	    ok = CBC_stream_random_updates(&st, &streamed, &plain, 0)
+		&& buffer_equality(&streamed, &reference);
+
+	    // 3. Streamed and one-shot decryption give plain back
+	    buffer_reset(&decrypted);
+	    aes_CBC_decrypt_init(&st, &key, modes[m]);
+	    ok = ok && CBC_stream_random_updates(&st, &decrypted, &reference, 1)
+		&& buffer_equality(&decrypted, &plain);
+	    ok = ok && aes_CBC_decrypt(&decrypted, &reference, &key, modes[m])
+		&& buffer_equality(&decrypted, &plain);
+
+	    // 4. A flipped bit is rejected by both
+	    reference.tab[rand() % reference.length] ^= 1 << (rand() % 8);
+	    ok = ok && !aes_CBC_decrypt(&decrypted, &reference, &key, modes[m]);
+	    buffer_reset(&decrypted);
+	    aes_CBC_decrypt_init(&st, &key, modes[m]);
+	    ok = ok && !CBC_stream_random_updates(&st, &decrypted, &reference, 1);
+
+	    // 5. In place = raw CBC, on the full blocks of plain
+	    plain.length -= plain.length % BLOCK_LENGTH;
+	    aes_raw_CBC_encrypt(&raw, &plain, &key, &IV);
+	    buffer_clone(&streamed, &plain);
+	    ok = ok && aes_cbc_encrypt_inplace(&ctx, IV.tab, streamed.tab,
+					       streamed.length)
+		&& memcmp(streamed.tab, raw.tab + BLOCK_LENGTH,
+			  streamed.length) == 0;
+	    ok = ok && aes_cbc_decrypt_inplace(&ctx, IV.tab, streamed.tab,
+					       streamed.length)
+		&& buffer_equality(&streamed, &plain);
+	}
+	printf("CBC with padding '%c', streamed and in place ", modes[m]);
+	if(ok)
+	    printf("[OK]\n");
+	else
+	    printf("[FAILED]\n");
+    }
+    printf("\n");
+
+    // 6. Free memory
+    aes_ctx_clear(&ctx);
+    buffer_clear(&key);
+    buffer_clear(&IV);
+    buffer_clear(&plain);
+    buffer_clear(&reference);
+    buffer_clear(&streamed);
+    buffer_clear(&decrypted);
+    buffer_clear(&raw);
+}
+
+
+/* Test cases 1 to 6 of the GCM specification (McGrew and Viega), AES-128 :
+   5 has a 64-bit IV and 6 a 480-bit one, 4 to 6 have associated data */
+static const char *gcm_kat[][6] = {
+    /* key, IV, plain text, aad, cipher text, tag */
+    {"00000000000000000000000000000000", "000000000000000000000000", "", "",
+     "", "58e2fccefa7e3061367f1d57a4e7455a"},
+    {"00000000000000000000000000000000", "000000000000000000000000",
+     "00000000000000000000000000000000", "",
+     "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf"},
+    {"feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255", "",
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+     "4d5c2af327cd64a62cf35abd2ba6fab4"},
+    {"feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+     "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+     "5bc94fbc3221a5db94fae95ae7121a47"},
+    {"feffe9928665731c6d6a8f9467308308", "cafebabefacedbad",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+     "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+     "61353b4c2806934a777ff51fa22a4755699b2a714fcdc6f83766e5f97b6c7423"
+     "73806900e49f24b22b097544d4896b424989b5e1ebac0f07c23f4598",
+     "3612d2e79e3b0785561be14aaca2fccb"},
+    {"feffe9928665731c6d6a8f9467308308",
+     "9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728"
+     "c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+     "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+     "8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca7"
+     "01e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5",
+     "619cc5aefffe0bfa462af43c1699d050"}
+};
+
+
+static void buffer_from_hex(buffer_t *buf, const char *hex){
+    unsigned int byte;
+    buffer_reset(buf);
+    for(; hex[0] != '\0' && hex[1] != '\0'; hex += 2){
+	sscanf(hex, "%2x", &byte);
+	buffer_append_uchar(buf, (uchar)byte);
+    }
+}
+
+
+/* Runs on the GHASH the library was built with : build it with
+   make GHASHFLAGS=-DGHASH_CLMUL=0 to check the 4-bit tables too */
+void test_aes_GCM(){
+    // 1. Initialisation
+    int nr_kat = sizeof(gcm_kat) / sizeof(gcm_kat[0]);
+    buffer_t key, IV, plain, aad, cipher, tag, encrypted, tag_test, decrypted;
+    buffer_init(&key, BLOCK_LENGTH);
+    buffer_init(&IV, GCM_IV_LENGTH);
+    buffer_init(&plain, 64);
+    buffer_init(&aad, 32);
+    buffer_init(&cipher, 64);
+    buffer_init(&tag, GCM_TAG_LENGTH);
+    buffer_init(&encrypted, 64);
+    buffer_init(&tag_test, GCM_TAG_LENGTH);
+    buffer_init(&decrypted, 64);
+    aes_gcm_ctx_t ctx;
+    printf("GHASH with %s\n", ghash_clmul_available() ?
+	   "PCLMULQDQ" : "4-bit tables");
+
+    // 2. Known answers, then the same tag with one bit flipped
+    for(int i = 0; i < nr_kat; i++){
+	buffer_from_hex(&key, gcm_kat[i][0]);
+	buffer_from_hex(&IV, gcm_kat[i][1]);
+	buffer_from_hex(&plain, gcm_kat[i][2]);
+	buffer_from_hex(&aad, gcm_kat[i][3]);
+	buffer_from_hex(&cipher, gcm_kat[i][4]);
+	buffer_from_hex(&tag, gcm_kat[i][5]);
+	aes_GCM_ctx_init(&ctx, &key);
+	int ok = aes_raw_GCM_encrypt_ctx(&encrypted, &tag_test, &plain, &aad,
+					 &ctx, &IV)
+	    && buffer_equality(&encrypted, &cipher)
+	    && buffer_equality(&tag_test, &tag);
+	ok = ok && aes_raw_GCM_decrypt_ctx(&decrypted, &cipher, &tag, &aad,
+					   &ctx, &IV)
+	    && buffer_equality(&decrypted, &plain);
+	tag.tab[i % GCM_TAG_LENGTH] ^= 1;
+	ok = ok && !aes_raw_GCM_decrypt_ctx(&decrypted, &cipher, &tag, &aad,
+					    &ctx, &IV)
+	    && decrypted.length == 0;
+	aes_GCM_ctx_clear(&ctx);
+	printf("GCM test case %d (IV of %d bytes, %d bytes of aad) ", i + 1,
+	       (int)IV.length, (int)aad.length);
+	if(ok)
+	    printf("[OK]\n");
+	else
+	    printf("[FAILED]\n");
+    }
+
+    // 3. IV || C || tag, then a flipped bit of C is rejected
+    printf("GCM encryption and decryption ");
+    aes_key_generation(&key, BLOCK_LENGTH);
+    buffer_random(&IV, GCM_IV_LENGTH);
+    buffer_random(&plain, 1000);
+    aes_GCM_encrypt(&encrypted, &plain, &key, &IV);
+    int ok = aes_GCM_decrypt(&decrypted, &encrypted, &key)
+	&& buffer_equality(&decrypted, &plain);
+    encrypted.tab[GCM_IV_LENGTH + 100] ^= 0x80;
+    ok = ok && !aes_GCM_decrypt(&decrypted, &encrypted, &key);
+    if(ok)
+	printf("[OK]\n\n");
+    else
+	printf("[FAILED]\n\n");
+
+    // 4. Free memory
+    buffer_clear(&key);
+    buffer_clear(&IV);
+    buffer_clear(&plain);
+    buffer_clear(&aad);
+    buffer_clear(&cipher);
+    buffer_clear(&tag);
+    buffer_clear(&encrypted);
+    buffer_clear(&tag_test);
+    buffer_clear(&decrypted);
+}
+
+
+void test_avalanche(int mode, long nr_samples, int nr_threads){
+    // 1. Initialisation
+    double *sac = malloc(SAC_BITS * SAC_BITS * sizeof(double));
+    parallel_set_threads(nr_threads);
+
+    // 2. Matrix on stdout, time on stderr
+    unsigned long long t = ticks();
+    if(avalanche_sac(sac, mode, nr_samples))
+	avalanche_print(stdout, sac, mode, nr_samples);
+    t = ticks() - t;
+    fprintf(stderr, "SAC matrix (%ld samples) : %.2f per AES block\n",
+	    nr_samples, (double)t / (nr_samples * (SAC_BITS + 1)));
+
+    // 3. Free memory
+    free(sac);
+}
+
+
+void test_diffusion_rounds(){
+    // 1. Initialisation
+    buffer_t msg, key;
+    buffer_init(&msg, BLOCK_LENGTH);
+    buffer_init(&key, 32);
+    int nr_tests = 10000;
+    double result[AES_MAX_ROUNDS];
+    uchar states[AES_MAX_ROUNDS * BLOCK_LENGTH], encrypted[BLOCK_LENGTH];
+    aes_ctx_t ctx;
+
+    for(int key_length = 16; key_length <= 32; key_length += 8){
+	// 2. Round sweep of the full cipher, one encryption per sample
+	buffer_random(&msg, BLOCK_LENGTH);
+	int Nr = diffusion_test_rounds(&msg, key_length, nr_tests, result);
+	printf("AES with a key of %d bits (%d tries) :\n",
+	       8 * key_length, nr_tests);
+	for(int r = 1; r <= Nr; r++)
+	    printf("diffusion after round %d : %f\n", r, result[r - 1]);
+
+	// 3. The last tapped state is the cipher text
+	int ok = 1;
+	for(int i = 0; i < 100; i++){
+	    buffer_random(&key, key_length);
+	    buffer_random(&msg, BLOCK_LENGTH);
+	    aes_ctx_init(&ctx, &key);
+	    aes_ctx_encrypt_rounds(&ctx, states, msg.tab);
+	    aes_ctx_encrypt(&ctx, encrypted, msg.tab);
+	    ok &= memcmp(states + (Nr - 1) * BLOCK_LENGTH, encrypted,
+			 BLOCK_LENGTH) == 0;
+	    aes_ctx_clear(&ctx);
+	}
+	printf("last round = aes_ctx_encrypt ");
+	if(ok)
+	    printf("[OK]\n\n");
+	else
+	    printf("[FAILED]\n\n");
+    }
+
+    // 4. Free memory
+    buffer_clear(&msg);
+    buffer_clear(&key);
+}
+
+
 void usage(char *s){
     fprintf(stderr, "Usage: %s <test_number>\n", s);
+    fprintf(stderr, "       %s 6|7 [nr_samples [nr_threads]]"
+	    " (SAC matrix for message|key bits)\n", s);
 }
 
 
@@ -137,6 +536,27 @@ int main(int argc, char *argv[]){
     case 3:
 	test_diffusion_few_rounds();
 	break;
+    case 4:
+	test_aes_speed();
+	break;
+    case 5:
+	test_aes_CTR();
+	break;
+    case 6:
+    case 7:
+	test_avalanche(n == 6 ? SAC_MSG : SAC_KEY,
+		       argc > 2 ? atol(argv[2]) : 10000,
+		       argc > 3 ? atoi(argv[3]) : 0);
+	break;
+    case 8:
+	test_aes_GCM();
+	break;
+    case 9:
+	test_aes_CBC_stream();
+	break;
+    case 10:
+	test_diffusion_rounds();
+	break;
     }
 	
 }
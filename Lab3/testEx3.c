@@ -9,9 +9,12 @@ Last modification : October 05, 2023
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "gmp.h"
 #include "buffer.h"
 #include "random.h"
 #include "sha3.h"
+#include "drbg.h"
 #include "aes.h"
 #include "operating_modes.h"
 #include "attack_RFC2040.h"
@@ -38,6 +41,8 @@ void test_oracle(){
 
     // 2. Fill in buffers
     aes_key_generation(&key, BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
     buffer_random(&IV, BLOCK_LENGTH);
     buffer_from_string(&msg, (uchar *)"Is there a problem with Earth's gravitational pull in the future? Why is everything so heavy?", -1);
     pad(&padded, &msg, 'R');
@@ -54,7 +59,7 @@ void test_oracle(){
 
     // 4. Test oracle on valid cipher
     printf("\nTest oracle on valid cipher : ");
-    if(oracle(&encrypted, &key))
+    if(oracle(&encrypted, &ctx))
 	printf("\t\t[OK]\n");
     else
 	printf("\t\t[FAILED]\n");
@@ -62,13 +67,14 @@ void test_oracle(){
     // 5. Test oracle on invalid cipher :
     encrypted.tab[encrypted.length - 1] = 1;
     printf("\nTest oracle on in-valid cipher : ");
-    if(!oracle(&encrypted, &key))
+    if(!oracle(&encrypted, &ctx))
 	printf("\t[OK]\n\n");
     else
 	printf("\t\t[FAILED]\n\n");
 	
 	
     // 6. Free Memory
+    aes_ctx_clear(&ctx);
     buffer_clear(&key);
     buffer_clear(&IV);
     buffer_clear(&msg);
@@ -89,6 +95,8 @@ void test_get_padding_position(){
 	
     // 2. Fill in buffers
     aes_key_generation(&key, BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
     buffer_random(&IV, BLOCK_LENGTH);
     int pad_position;
 
@@ -105,7 +113,7 @@ void test_get_padding_position(){
 	printf("\nLength of encrypted = %ld.\n\n", encrypted.length);
 #endif
 
-	pad_position = get_padding_position(&encrypted, &key);
+	pad_position = get_padding_position(&encrypted, &ctx);
 	implementation_check("get_padding_position", pad_position);
     printf("Output of get_padding_position: \t %d\n", pad_position);
     printf("Expected output of the function: \t %d\n\n", BLOCK_LENGTH - a);
@@ -127,6 +135,7 @@ void test_get_padding_position(){
     buffer_clear(&padded);
     buffer_clear(&encrypted);
     buffer_clear(&encrypted_2);
+    aes_ctx_clear(&ctx);
     buffer_clear(&key);
     buffer_clear(&IV);	
 }
@@ -219,6 +228,8 @@ void test_find_last_byte(){
 	
     // 2. Fill in buffers
     aes_key_generation(&key, BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
     buffer_random(&IV, BLOCK_LENGTH);
 
     // 3. Loop
@@ -229,7 +240,7 @@ void test_find_last_byte(){
 	pad(&padded, &plain, 'R');
 	
 	aes_raw_CBC_encrypt(&encrypted, &padded, &key, &IV);
-	int pad_position = get_padding_position(&encrypted, &key);
+	int pad_position = get_padding_position(&encrypted, &ctx);
 	implementation_check("get_padding_position", pad_position);
 	pad_position += encrypted.length - BLOCK_LENGTH;
 	printf("Padding position = %d.\n\n",
@@ -254,7 +265,7 @@ void test_find_last_byte(){
 	buffer_clear(&decrypted);
 #endif
 		
-	success = find_last_byte(&hack, &corrupted, pad_position - 1, &key);
+	success = find_last_byte(&hack, &corrupted, pad_position - 1, &ctx);
 	implementation_check("find_last_byte", success);
 	printf("Candidate for last byte = %u, should be = %u\t\t", hack,
 	       padded.tab[pad_position - 1 - BLOCK_LENGTH]);
@@ -275,6 +286,7 @@ void test_find_last_byte(){
     buffer_clear(&padded);
     buffer_clear(&corrupted);
     buffer_clear(&encrypted);
+    aes_ctx_clear(&ctx);
     buffer_clear(&key);
     buffer_clear(&IV);	
 }
@@ -296,11 +308,13 @@ void test_full_attack(){
     buffer_random(&plain, i);
     buffer_random(&IV, BLOCK_LENGTH);
     buffer_random(&key, BLOCK_LENGTH);
+    aes_ctx_t ctx;
+    aes_ctx_init(&ctx, &key);
 
     // 2. Pad
     int pad = BLOCK_LENGTH - (i % BLOCK_LENGTH);
-    for(int i = 0; i < pad; i++)
-	buffer_append_uchar(&plain, (uchar)pad);
+    buffer_set_length(&plain, i + pad);
+    memset(plain.tab + i, pad, pad);
 #if DEBUG
     printf("Plain text (with padding) :\n");
     buffer_print_int(stdout, &plain);
@@ -314,7 +328,7 @@ void test_full_attack(){
     // 4. Decrypt
     printf("--- Performing full attack ---\n\n");
     fflush(stdout);
-    success = full_attack(&decrypted, &encrypted, &key);
+    success = full_attack(&decrypted, &encrypted, &ctx);
     implementation_check("full_attack", success);
 
     // 5. compare
@@ -332,6 +346,7 @@ void test_full_attack(){
     buffer_clear(&plain);
     buffer_clear(&encrypted);
     buffer_clear(&decrypted);
+    aes_ctx_clear(&ctx);
     buffer_clear(&key);
     buffer_clear(&IV);
 }
@@ -353,6 +368,7 @@ int main(int argc, char *argv[]){
     if(argc > 2)
 	r = atoi(argv[2]);
     srand(r);
+    drbg_seed_ui(r);
     switch(n){
     case 1:
 	test_oracle();
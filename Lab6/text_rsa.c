@@ -85,8 +85,7 @@ int RSA_text_decrypt(buffer_t *decrypted, mpz_t *cipher,
         RSA_decrypt(decrypt_mpz, cipher[i], N, d);
         mpz_export(decrypt_append, &cnt, 1, 1, 0, 0, decrypt_mpz);
         
-        for (int j = 0; j < cnt; j++)
-            buffer_append_uchar(decrypted, decrypt_append[j]);
+        buffer_append_bytes(decrypted, decrypt_append, cnt);
     }
 
     return status;
@@ -7,6 +7,7 @@
 #include "gmp.h"
 #include "buffer.h"
 #include "sha3.h"
+#include "sha3_tree.h"
 
 #include "rsa.h"
 #include "sign.h"
@@ -23,12 +24,14 @@ int dsa_sign_dummy(buffer_t *msg, mpz_t p,
 /* to be filled in */
     mpz_t hash_msg, tmp;
     mpz_inits(hash_msg, tmp, NULL);
-    buffer_t hash;
 
     // Generate hash of msg
-    buffer_init(&hash, hash_length(q));
-    buffer_hash(&hash, hash_length(q), msg);
-    mpz_import(hash_msg, hash_length(q), 1, 1, 0, 0, hash.tab);
+    if(!sign_buffer_hash(hash_msg, hash_length(q), msg)){
+	mpz_set_ui(r, 0);
+	mpz_set_ui(s, 0);
+	mpz_clears(hash_msg, tmp, NULL);
+	return 0;
+    }
 
     // no need to ramdom, use precise k
     mpz_powm(r, a, k, p);
@@ -103,17 +106,14 @@ int dsa_attack(mpz_t x, buffer_t *msg1, buffer_t *msg2,
     
 /* to be filled in */
     mpz_t hash_msg1, hash_msg2;
-	buffer_t hash;
 
 	mpz_inits(hash_msg1, hash_msg2, NULL);
 
-    buffer_init(&hash, hash_length(q));
-    buffer_hash(&hash, hash_length(q), msg1);
-    mpz_import(hash_msg1, hash_length(q), 1, 1, 0, 0, hash.tab);
-
-    buffer_init(&hash, hash_length(q));
-    buffer_hash(&hash, hash_length(q), msg2);
-    mpz_import(hash_msg2, hash_length(q), 1, 1, 0, 0, hash.tab);
+    if(!sign_buffer_hash(hash_msg1, hash_length(q), msg1)
+       || !sign_buffer_hash(hash_msg2, hash_length(q), msg2)){
+	mpz_clears(hash_msg1, hash_msg2, NULL);
+	return 0;
+    }
 
     // Return x
 	solve_system_modq(x, r1, s1, r2, s2, hash_msg1, hash_msg2, q);
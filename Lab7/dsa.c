@@ -8,6 +8,7 @@
 
 #include "buffer.h"
 #include "sha3.h"
+#include "sha3_tree.h"
 
 #include "rsa.h"
 #include "sign.h"
@@ -136,20 +137,12 @@ void dsa_key_import(const char* key_file_name, mpz_t p, mpz_t q, mpz_t a,
 }
 
 
-int dsa_sign_buffer(buffer_t *msg, mpz_t p,
-		    mpz_t q, mpz_t a, mpz_t x, mpz_t r, mpz_t s,
-		    gmp_randstate_t state){
-    int status = 0;
-/* to be filled in */
-
-    buffer_t hash;
-    mpz_t hash_msg, k, tmp, inv_k;
-    mpz_inits(hash_msg, k, tmp, inv_k, NULL);
-
-    // Generate hash of msg
-    buffer_init(&hash, hash_length(q));
-    buffer_hash(&hash, hash_length(q), msg);
-    mpz_import(hash_msg, hash_length(q), 1, 1, 1, 0, hash.tab);
+/* Signs the hash hash_msg, which may be s itself */
+static void dsa_sign_hash(mpz_t hash_msg, mpz_t p,
+			  mpz_t q, mpz_t a, mpz_t x, mpz_t r, mpz_t s,
+			  gmp_randstate_t state){
+    mpz_t k, tmp, inv_k;
+    mpz_inits(k, tmp, inv_k, NULL);
 
     // Generate sign
 
@@ -163,9 +156,27 @@ int dsa_sign_buffer(buffer_t *msg, mpz_t p,
     mpz_mul(tmp, tmp, inv_k); // tmp = tmp * k^(-1)
     mpz_mod(s, tmp, q);
 
+    mpz_clears(k, tmp, inv_k, NULL);
+}
+
+
+int dsa_sign_buffer(buffer_t *msg, mpz_t p,
+		    mpz_t q, mpz_t a, mpz_t x, mpz_t r, mpz_t s,
+		    gmp_randstate_t state){
+    int status = 0;
+/* to be filled in */
 
-    mpz_clears(hash_msg, k, tmp, inv_k, NULL);
-    buffer_clear(&hash);
+    // Generate hash of msg, in s until the signature replaces it
+    status = sign_buffer_hash(s, hash_length(q), msg);
+    if(!status){
+	// r = 0 is never a valid signature
+	mpz_set_ui(r, 0);
+	mpz_set_ui(s, 0);
+	return status;
+    }
+
+    // Generate sign
+    dsa_sign_hash(s, p, q, a, x, r, s, state);
 
     return status;
 }
@@ -176,24 +187,24 @@ void dsa_sign(const char* file_name, const char* key_file_name,
 	      gmp_randstate_t state){
     // 1. Initialisation
     mpz_t p, q, a, x, r, s;
-    buffer_t msg;
     mpz_inits(r, s, p, q, a, x, NULL);
-    buffer_init(&msg, 100);
 	
-    // 2. Import the message
-    buffer_from_file(&msg, file_name);
-#if DEBUG
-    printf("Length of the message = %lu.\n", msg.length);
-#endif
-
-    /* 3. Parse the secret key */
+    /* 2. Parse the secret key */
     dsa_key_import(key_file_name, p, q, a, x);
 #if DEBUG > 0
     gmp_printf("p = %#Zx\nq = %#Zx\n", p, q);
 #endif
+
+    /* 3. Hash the file piece by piece, into s */
+    if(!sign_file_hash(s, hash_length(q), file_name)){
+	fprintf(stderr, "[dsa_sign] : cannot hash %s, nothing signed.\n",
+		file_name);
+	mpz_clears(p, q, a, x, r, s, NULL);
+	return;
+    }
 	
     /* 4. Sign */
-    dsa_sign_buffer(&msg, p, q, a, x, r, s, state);
+    dsa_sign_hash(s, p, q, a, x, r, s, state);
 
     /* 5. Write signature in a file */
     FILE* sgn = fopen(signature_file_name, "w");
@@ -202,14 +213,13 @@ void dsa_sign(const char* file_name, const char* key_file_name,
     /* . Cleaning */
     mpz_clears(p, q, a, x, r, s, NULL);
     fclose(sgn);
-    buffer_clear(&msg);
 }
 
 
-int dsa_verify_buffer(buffer_t *msg, mpz_t p, mpz_t q,
-		      mpz_t a, mpz_t r, mpz_t s, mpz_t y){
+/* 1 if (r, s) is a signature of the hash hash_msg */
+static int dsa_verify_hash(mpz_t hash_msg, mpz_t p, mpz_t q,
+			   mpz_t a, mpz_t r, mpz_t s, mpz_t y){
     int verify = 0;
-/* to be filled in */
 
     // Verify if r, s legal
     if (mpz_cmp_ui(r, 0) <= 0 || mpz_cmp(r, q) >= 0 || 
@@ -217,14 +227,8 @@ int dsa_verify_buffer(buffer_t *msg, mpz_t p, mpz_t q,
         return 0;
     }
 
-    buffer_t hash;
-    mpz_t hash_msg, w, u1, u2, tmp, g_u1, y_u2, v;
-    mpz_inits(hash_msg, w, u1, u2, tmp, g_u1, y_u2, v, NULL);
-
-    // Generate hash of msg
-    buffer_init(&hash, hash_length(q));
-    buffer_hash(&hash, hash_length(q), msg);
-    mpz_import(hash_msg, hash_length(q), 1, 1, 1, 0, hash.tab);
+    mpz_t w, u1, u2, tmp, g_u1, y_u2, v;
+    mpz_inits(w, u1, u2, tmp, g_u1, y_u2, v, NULL);
 
     mpz_invert(w, s, q);
 
@@ -243,8 +247,25 @@ int dsa_verify_buffer(buffer_t *msg, mpz_t p, mpz_t q,
 
     verify = !mpz_cmp(v, r);
 
-    mpz_clears(hash_msg, w, u1, u2, tmp, g_u1, y_u2, v, NULL);
-    buffer_clear(&hash);
+    mpz_clears(w, u1, u2, tmp, g_u1, y_u2, v, NULL);
+
+    return verify;
+}
+
+
+int dsa_verify_buffer(buffer_t *msg, mpz_t p, mpz_t q,
+		      mpz_t a, mpz_t r, mpz_t s, mpz_t y){
+    int verify = 0;
+/* to be filled in */
+
+    mpz_t hash_msg;
+    mpz_init(hash_msg);
+
+    // Generate hash of msg
+    if(sign_buffer_hash(hash_msg, hash_length(q), msg))
+	verify = dsa_verify_hash(hash_msg, p, q, a, r, s, y);
+
+    mpz_clear(hash_msg);
 
     return verify;
 }
@@ -267,27 +288,25 @@ void dsa_import_signature(mpz_t r, mpz_t s, const char* signature_file_name){
 int dsa_verify(const char* file_name, const char* key_file_name,
 	       const char* signature_file_name){
     // 1. INIT
-    mpz_t p, q, a, y, r, s;
-    buffer_t msg;
-    mpz_inits(p, q, a, y, r, s, NULL);
-    buffer_init(&msg, 100);
+    mpz_t p, q, a, y, r, s, h;
+    mpz_inits(p, q, a, y, r, s, h, NULL);
 	
-    // 2. Imports the message
-    buffer_from_file(&msg, file_name);
-	
-    // 3. Parse the public key 
+    // 2. Parse the public key 
     dsa_key_import(key_file_name, p, q, a, y);
 
 #if DEBUG > 0
     gmp_printf("\n\np = %#Zx\nq = %#Zx\n\n", p, q);
 #endif
+
+    // 3. Hash the file piece by piece
+    int verify = sign_file_hash(h, hash_length(q), file_name);
 	
     // 4. Parse the signature 
     dsa_import_signature(r, s, signature_file_name);
-    int verify = dsa_verify_buffer(&msg, p, q, a, r, s, y);
+    if(verify)
+	verify = dsa_verify_hash(h, p, q, a, r, s, y);
 	
     // 5. Cleaning and return
-    mpz_clears(p, q, a, y, r, s, NULL);
-    buffer_clear(&msg);
+    mpz_clears(p, q, a, y, r, s, h, NULL);
     return verify;
 }
@@ -8,11 +8,14 @@
 
 #include "buffer.h"
 #include "sha3.h"
+#include "sha3_tree.h"
 #include "rsa.h"
 #include "sign.h"
 
 #define DEBUG 0
 
+static int sign_hash = SIGN_HASH_SHA3;
+
 
 int RSA_generate_key_files(const char *pk_file_name,
 			   const char *sk_file_name,
@@ -65,22 +68,40 @@ int hash_length(mpz_t N){
 }
 
 
+void sign_set_hash(int hash){
+    sign_hash = hash == SIGN_HASH_TREE ? SIGN_HASH_TREE : SIGN_HASH_SHA3;
+}
+
+
+/* h = hash of msg on length bytes, read as a big-endian integer;
+   0 if it cannot be computed */
+int sign_buffer_hash(mpz_t h, int length, buffer_t *msg){
+    if(sign_hash == SIGN_HASH_TREE)
+	return buffer_hash_tree_to_mpz(h, length, msg);
+    return buffer_hash_to_mpz(h, length, msg);
+}
+
+
+/* Same for a file, read by pieces */
+int sign_file_hash(mpz_t h, int length, const char *file_name){
+    if(sign_hash == SIGN_HASH_TREE)
+	return file_hash_tree_to_mpz(h, length, file_name);
+    return file_hash_to_mpz(h, length, file_name);
+}
+
+
 int RSA_sign_buffer(mpz_t sgn, buffer_t *msg,
 		    mpz_t N, mpz_t d){
     int status = 1;
 /* to be filled in */
-    buffer_t hash;
-    buffer_init(&hash, msg->size);
-
-    mpz_t tmp;
-    mpz_init(tmp);
-
-    buffer_hash(&hash, hash_length(N), msg);
-    mpz_import(tmp, hash_length(N), 1, 1, 1, 0, hash.tab);
-    RSA_encrypt(sgn, tmp, N, d);
-
-    mpz_clear(tmp);
-    buffer_clear(&hash);
+    // The hash goes straight into sgn, which is then signed in place
+    status = sign_buffer_hash(sgn, hash_length(N), msg);
+    if(!status){
+	// no hash, nothing to sign : sgn is not left as a signature
+	mpz_set_ui(sgn, 0);
+	return status;
+    }
+    RSA_encrypt(sgn, sgn, N, d);
 
     return status;
 }
@@ -115,25 +136,34 @@ int RSA_sign_buffer(mpz_t sgn, buffer_t *msg,
 // }
 
 
-int RSA_verify_signature(mpz_t sgn, buffer_t *msg,
-			 mpz_t N, mpz_t e){
+/* 1 if sgn is a signature of the hash h */
+static int RSA_verify_hash(mpz_t sgn, mpz_t h, mpz_t N, mpz_t e){
     int verify = 0;
-/* to be filled in */
+    mpz_t msg_decrypt;
+    mpz_init(msg_decrypt);
 
-    buffer_t hash;
-    buffer_init(&hash, msg->size);
+    RSA_decrypt(msg_decrypt, sgn, N, e);
 
-    mpz_t msg_tmp, msg_decrypt;
-    mpz_inits(msg_tmp, msg_decrypt, NULL);
+    if(mpz_cmp(msg_decrypt, h) == 0)
+        verify = 1;
 
-    buffer_hash(&hash, hash_length(N), msg);
-    mpz_import(msg_tmp, hash_length(N), 1, 1, 1, 0, hash.tab);
+    mpz_clear(msg_decrypt);
+    return verify;
+}
 
-    RSA_decrypt(msg_decrypt, sgn, N, e);
 
-    if(mpz_cmp(msg_decrypt, msg_tmp) == 0)
-        verify = 1;
+int RSA_verify_signature(mpz_t sgn, buffer_t *msg,
+			 mpz_t N, mpz_t e){
+    int verify = 0;
+/* to be filled in */
+
+    mpz_t h;
+    mpz_init(h);
+
+    if(sign_buffer_hash(h, hash_length(N), msg))
+	verify = RSA_verify_hash(sgn, h, N, e);
 
+    mpz_clear(h);
     return verify;
 }
 
@@ -150,56 +180,51 @@ void RSA_signature_import(mpz_t S, const char* signature_file_name){
 void RSA_sign(const char* file_name, const char* key_file_name,
 	      const char* signature_file_name){
     // 1. Initialisation
-    buffer_t msg;
     mpz_t N, d, signature;
     mpz_inits(N, d, signature, NULL);
-    buffer_init(&msg, 100);
 
-    // 2. Import the message in a buffer
-    buffer_from_file(&msg, file_name);
-	
-    // 3. Parse the secret key
+    // 2. Parse the secret key
     RSA_key_import(N, d, key_file_name);
 
-    // 4. Sign the buffer
-    int status = RSA_sign_buffer(signature, &msg, N, d);
-    implementation_check("RSA_sign_buffer", status);
+    // 3. Hash the file piece by piece, then sign the hash
+    if(!sign_file_hash(signature, hash_length(N), file_name)){
+	fprintf(stderr, "[RSA_sign] : cannot hash %s, nothing signed.\n",
+		file_name);
+	mpz_clears(N, d, signature, NULL);
+	return;
+    }
+    RSA_encrypt(signature, signature, N, d);
 
-    // 5. Exports the signature in a file
+    // 4. Exports the signature in a file
     FILE* sgn = fopen(signature_file_name, "w");
     gmp_fprintf(sgn, "#RSA signature\nS = %#Zx\n", signature);
 	
-    // 6. Close and free
+    // 5. Close and free
     fclose(sgn);
     mpz_clears(N, d, signature, NULL);
-    buffer_clear(&msg);
 }
 
 
 int RSA_verify(const char* file_name, const char* key_file_name,
 	       const char* signature_file_name){
     // 1. Initialisation
-    buffer_t msg;
-    mpz_t N, e, S;	
-    buffer_init(&msg, 100);
-    mpz_inits(N, e, S, NULL);	
-
-	
-    // 2. Import the message into a buffer
-    buffer_from_file(&msg, file_name);
+    mpz_t N, e, S, h;	
+    mpz_inits(N, e, S, h, NULL);	
 
-    // 3. Import the public key
+    // 2. Import the public key
     RSA_key_import(N, e, key_file_name);
 
+    // 3. Hash the file piece by piece
+    int verify = sign_file_hash(h, hash_length(N), file_name);
+
     // 4. Parse the signature
     RSA_signature_import(S, signature_file_name);
 	
     // 5. Verify
-    int verify = RSA_verify_signature(S, &msg, N, e);
-    implementation_check("RSA_verify_signature", verify);
+    if(verify)
+	verify = RSA_verify_hash(S, h, N, e);
 	
     // 6. Close, free and return
-    mpz_clears(S, N, e, NULL);
-    buffer_clear(&msg);
+    mpz_clears(S, N, e, h, NULL);
     return verify;
 }
@@ -6,6 +6,16 @@ int RSA_generate_key_files(const char *pk_file_name,
 void RSA_key_import(mpz_t N, mpz_t ed, const char *pk_file_name);
 void RSA_signature_import(mpz_t S, const char* signature_file_name);
 int hash_length(mpz_t N);
+
+/* Hash of the messages signed or verified : SHA3 by default, or
+   ParallelHash256 (faster on large files) once asked for. Nothing in a
+   signature tells which one was used, both ends must agree. */
+#define SIGN_HASH_SHA3 0
+#define SIGN_HASH_TREE 1
+void sign_set_hash(int hash);
+int sign_buffer_hash(mpz_t h, int length, buffer_t *msg);
+int sign_file_hash(mpz_t h, int length, const char *file_name);
+
 int RSA_sign_buffer(mpz_t sgn, buffer_t *msg, mpz_t N, mpz_t d);
 int RSA_verify_signature(mpz_t sgn, buffer_t *msg, mpz_t N, mpz_t e);
 void RSA_sign(const char* file_name, const char* key_file_name,
@@ -10,6 +10,7 @@
 #include "buffer.h"
 #include "rsa.h"
 #include "sha3.h"
+#include "sha3_multi.h"
 #include "sign.h"
 #include "dsa.h"
 #include "attack_dsa.h"
@@ -527,6 +528,85 @@ void test11(gmp_randstate_t state){
 
 
 
+/* Best of a few runs of nr_calls permutations */
+static double keccakf_speed(void (*keccakf)(uint64_t *), int nr_calls){
+    uint64_t st[25] = {0};
+    unsigned long long best = -1, t;
+    for(int run = 0; run < 8; run++){
+	t = ticks();
+	for(int i = 0; i < nr_calls; i++)
+	    keccakf(st);
+	t = ticks() - t;
+	if(t < best)
+	    best = t;
+    }
+    return (double)best / nr_calls;
+}
+
+
+void test12(){
+    /* 1. INIT */
+    int nr_calls = 1 << 14, length = 1 << 22, rate = 200 - 2 * 32;
+    uchar *data = malloc(length);
+    uchar md[32];
+    for(int i = 0; i < length; i++)
+	data[i] = (uchar)i;
+
+    /* 2. Permutation alone, per byte of SHA3-256 input */
+    double ref = keccakf_speed(sha3_keccakf_ref, nr_calls);
+    double cur = keccakf_speed(sha3_keccakf, nr_calls);
+#if defined(__x86_64__) || defined(__i386__)
+    printf("Keccak-f[1600], cycles per byte of SHA3-256 :\n");
+#else
+    printf("Keccak-f[1600], clock ticks per byte of SHA3-256 :\n");
+#endif
+    printf("reference loop : %.2f\n", ref / rate);
+    printf("sha3_keccakf   : %.2f (%s)\n", cur / rate, sha3_engine());
+
+    /* 3. Whole hash, absorb included */
+    sha3_ctx_t ctx;
+    unsigned long long t = ticks();
+    sha3_init(&ctx, 32);
+    sha3_update(&ctx, data, length);
+    sha3_final(md, &ctx);
+    t = ticks() - t;
+    printf("SHA3-256 of %d bytes : %.2f\n", length, (double)t / length);
+
+    /* 4. Many short messages, one at a time then in a batch */
+    int nr_msg = 1 << 12, msg_length = 64;
+    uchar (*digest)[32] = malloc(nr_msg * sizeof(*digest));
+    uint8_t **mds = malloc(nr_msg * sizeof(uint8_t *));
+    const uint8_t **in = malloc(nr_msg * sizeof(uint8_t *));
+    size_t *len = malloc(nr_msg * sizeof(size_t));
+    for(int i = 0; i < nr_msg; i++){
+	mds[i] = digest[i];
+	in[i] = data + i * msg_length;
+	len[i] = msg_length;
+    }
+    t = ticks();
+    for(int i = 0; i < nr_msg; i++){
+	sha3_init(&ctx, 32);
+	sha3_update(&ctx, in[i], len[i]);
+	sha3_final(mds[i], &ctx);
+    }
+    t = ticks() - t;
+    printf("SHA3-256 of %d messages of %d bytes :\n", nr_msg, msg_length);
+    printf("one at a time : %.2f\n", (double)t / (nr_msg * msg_length));
+    t = ticks();
+    sha3_batch(mds, in, len, nr_msg, 32);
+    t = ticks() - t;
+    printf("sha3_batch    : %.2f (%s)\n\n", (double)t / (nr_msg * msg_length),
+	   sha3_multi_engine());
+
+    /* 5. Cleaning */
+    free(digest);
+    free(mds);
+    free(in);
+    free(len);
+    free(data);
+}
+
+
 static void usage(char *s, int ntests){
     fprintf(stderr, "Usage: %s <test_number in 1..%d>\n", s, ntests);
 }
@@ -537,7 +617,7 @@ int main(int argc, char *argv[]){
     int r = random_seed();
     
     if(argc == 1){
-	usage(argv[0], 11);
+	usage(argv[0], 12);
 	return 0;
     }
     int n = atoi(argv[1]);
@@ -585,6 +665,9 @@ int main(int argc, char *argv[]){
     case 11:
 	test11(state);
 	break;
+    case 12:
+	test12();
+	break;
     }
 
     gmp_randclear(state);
@@ -11,6 +11,7 @@
 
 #include "operating_modes.h"
 #include "aes.h"
+#include "drbg.h"
 
 #include "channel.h"
 
@@ -50,3 +51,43 @@ void msg_export_string(char *buf, const char *prefix, const char* in){
     sprintf(buf, "%s%s", prefix, in);
 }
 
+
+/* Cipher announced by mesg, -1 if mesg is not an announce. */
+int channel_cipher(const char *mesg){
+    if(strcmp(mesg, "AES-GCM") == 0)
+	return CHANNEL_GCM;
+    if(strncmp(mesg, "AES", 3) == 0)
+	return CHANNEL_CBC;
+    return -1;
+}
+
+const char *channel_cipher_name(int cipher){
+    return cipher == CHANNEL_GCM ? "AES-GCM" : "AES";
+}
+
+/* Encrypts clear with a fresh IV. CBC has a SHA3 hash appended,
+   GCM is authenticated with key. */
+int channel_encrypt(buffer_t *encrypted, buffer_t *clear, buffer_t *key,
+		    int cipher){
+    buffer_t IV;
+    int status;
+    if(cipher == CHANNEL_GCM){
+	buffer_init(&IV, GCM_IV_LENGTH);
+	buffer_random(&IV, GCM_IV_LENGTH);
+	status = aes_GCM_encrypt(encrypted, clear, key, &IV);
+    }
+    else{
+	buffer_init(&IV, BLOCK_LENGTH);
+	buffer_random(&IV, BLOCK_LENGTH);
+	status = aes_CBC_encrypt(encrypted, clear, key, &IV, 's');
+    }
+    buffer_clear(&IV);
+    return status;
+}
+
+int channel_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key,
+		    int cipher){
+    if(cipher == CHANNEL_GCM)
+	return aes_GCM_decrypt(decrypted, encrypted, key);
+    return aes_CBC_decrypt(decrypted, encrypted, key, 's');
+}
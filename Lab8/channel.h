@@ -1,5 +1,9 @@
 #ifndef __FRS__CHANNEL
 
+/* Ciphers of the channel, announced by the first message */
+#define CHANNEL_CBC 0 /* "AES" */
+#define CHANNEL_GCM 1 /* "AES-GCM" */
+
 void channel_init(mpz_t p, mpz_t g);
 
 int msg_import_mpz(mpz_t n, char *in, const char *prefix, int base);
@@ -7,4 +11,11 @@ void msg_export_mpz(char *buf, const char *prefix, mpz_t n, int base);
 int msg_import_string(char *buf, char *in, const char* prefix);
 void msg_export_string(char *buf, const char *prefix, const char* in);
 
+int channel_cipher(const char *mesg);
+const char *channel_cipher_name(int cipher);
+int channel_encrypt(buffer_t *encrypted, buffer_t *clear, buffer_t *key,
+		    int cipher);
+int channel_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key,
+		    int cipher);
+
 #endif
@@ -40,7 +40,7 @@ void Usage(char *s){
     /* fprintf(stderr, ""); */
     fprintf(stderr, "\t\t[--hostname CLIENT_HOST (default %s)]\n", DEFAULT_HOST);
     fprintf(stderr, "\t\t[--listen CLIENT_PORT (default %d)]\n", DEFAULT_PORT);
-    fprintf(stderr, "\t\t[ try_send | try_aes | try_send_aes | try_DH | try_STS | try_CTF ]\n");
+    fprintf(stderr, "\t\t[ try_send | try_aes | try_send_aes | try_send_aes_gcm | try_DH | try_STS | try_CTF ]\n");
     fprintf(stderr, "\t\t[--help]");
     fprintf(stderr, " [--name NAME]\n");
     fprintf(stderr, "\t\t[ OPTIONAL FILES ]\n");
@@ -50,6 +50,7 @@ void Usage(char *s){
     fprintf(stderr, "\ttry_send: \tTry to send a basic message. Modify and play with this function.\n");
     fprintf(stderr, "\ttry_aes: \tTry to encrypt a basic message with AES. Don't send anything.\n");
     fprintf(stderr, "\ttry_send_aes: \tEncrypt and send a basic message with AES.\n");
+    fprintf(stderr, "\ttry_send_aes_gcm: Same with AES-GCM instead of AES-CBC.\n");
     fprintf(stderr, "\ttry_DH: \tPerform DH key exchange and encrypt a message with the shared key.\n");
     fprintf(stderr, "\ttry_STS: \tPerform Station-To-Station protocol with the server.\n");
     fprintf(stderr, "\ttry_CTF: \tTry to retrieve the secret flag prepared for you. Needs your name.\n");
@@ -181,8 +182,11 @@ int main(int argc, char *argv[])
             free(packet);
             goto clear;
         }
-        if(strcmp(argv[optind], "try_send_aes") == 0){
-            try_send_aes(server_host, server_port);
+        if(strcmp(argv[optind], "try_send_aes") == 0
+           || strcmp(argv[optind], "try_send_aes_gcm") == 0){
+            try_send_aes(server_host, server_port,
+                         strcmp(argv[optind], "try_send_aes_gcm") == 0
+                         ? CHANNEL_GCM : CHANNEL_CBC);
             handle_reply(&from, &portfrom, &reply, &packet);
             free(from);
             free(reply);
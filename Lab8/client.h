@@ -14,7 +14,7 @@ void handle_reply(char **from, int *portfrom, char **reply, char **packet);
 
 void try_send(const char *host, const int port);
 void try_aes();
-void try_send_aes(const char *host, const int port);
+void try_send_aes(const char *host, const int port, int cipher);
 void CaseDH(const char *server_host, const int server_port, gmp_randstate_t state);
 void CaptureTheFlag(const char *server_host, const int server_port,
                     certificate_t *CA, mpz_t NA, mpz_t dA, mpz_t N_aut,
@@ -16,6 +16,7 @@
 
 #include "operating_modes.h"
 #include "aes.h"
+#include "drbg.h"
 
 #include "version.h"
 
@@ -116,27 +117,26 @@ void try_aes(){
     mpz_clear(gab);
 }
 
-int send_with_aes(const char *host, const int port, uchar *msg, mpz_t gab){
+int send_with_aes(const char *host, const int port, uchar *msg, mpz_t gab,
+		  int cipher){
     int status = 1;
 /* to be filled in */
 
-    printf("Sending: AES\n");
-    network_send(host, port, client_host, client_port, "AES");
+    printf("Sending: %s\n", channel_cipher_name(cipher));
+    network_send(host, port, client_host, client_port, channel_cipher_name(cipher));
 
     // Init
-    buffer_t clear, encrypted, key, IV, send_buf;
+    buffer_t clear, encrypted, key, send_buf;
     buffer_init(&clear, strlen((char*)msg));
     buffer_init(&encrypted, 1);
     buffer_init(&key, BLOCK_LENGTH);
-    buffer_init(&IV, BLOCK_LENGTH);
     buffer_init(&send_buf, 128);
 
     // AES
     AES128_key_from_number(&key, gab);
-    buffer_random(&IV, BLOCK_LENGTH);
     buffer_from_string(&clear, msg, strlen((char*)msg));
 
-    aes_CBC_encrypt(&encrypted, &clear, &key, &IV, 's');
+    channel_encrypt(&encrypted, &clear, &key, cipher);
 
     // Send to server
     buffer_to_base64(&send_buf, &encrypted);
@@ -151,7 +151,6 @@ int send_with_aes(const char *host, const int port, uchar *msg, mpz_t gab){
     buffer_clear(&clear);
     buffer_clear(&encrypted);
     buffer_clear(&key);
-    buffer_clear(&IV);
     buffer_clear(&send_buf);
     
     
@@ -159,12 +158,12 @@ int send_with_aes(const char *host, const int port, uchar *msg, mpz_t gab){
     return status;
 }
 
-void try_send_aes(const char *host, const int port){
+void try_send_aes(const char *host, const int port, int cipher){
     uchar *msg = (uchar*)"It's a long way to Tipperary";
     mpz_t gab;
 
     mpz_init_set_str(gab, "12345612345678907890", 10);
-    int status = send_with_aes(host, port, msg, gab);
+    int status = send_with_aes(host, port, msg, gab, cipher);
     implementation_check("send_with_aes", status);
     mpz_clear(gab);
 }
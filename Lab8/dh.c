@@ -28,12 +28,10 @@ void DH_init(mpz_t a, gmp_randstate_t state, int nbits){
 
 /* for AES 128 */
 void AES128_key_from_number(buffer_t *key, mpz_t n){
-    size_t nc, i;
+    size_t nc;
     uchar *tmp = (uchar *)calloc(BLOCK_LENGTH, sizeof(uchar));
     mpz_export(tmp, &nc, 1, 1, 1, 0, n);
-    uchar *cursor = tmp;
-    for(i = 0; i < BLOCK_LENGTH; i++, cursor++)
-	buffer_append_uchar(key, *cursor);
+    buffer_append_bytes(key, tmp, BLOCK_LENGTH);
     free(tmp);
 }
 
@@ -16,6 +16,7 @@
 
 #include "operating_modes.h"
 #include "aes.h"
+#include "drbg.h"
 
 #include "version.h"
 
@@ -52,8 +53,8 @@ void reply(const char *host, const int port){
 }
 
 
-/* INPUT: mesg = "AES" */
-void CaseAES(const char *client_host, const int client_port){
+/* INPUT: mesg = "AES" or "AES-GCM", giving the cipher */
+void CaseAES(const char *client_host, const int client_port, int cipher){
     char *packet = network_recv(-1);
     char *from_Alice;
     parse_packet(NULL, NULL, &from_Alice, packet); // Discard client_host and client_port
@@ -66,7 +67,7 @@ void CaseAES(const char *client_host, const int client_port){
     mpz_init_set_str(gab, "12345612345678907890", 10);
     AES128_key_from_number(&key, gab);
 
-    printf("AES/RECV: %s\n", from_Alice);
+    printf("%s/RECV: %s\n", channel_cipher_name(cipher), from_Alice);
     fflush(stdout);
     buffer_init(&in, N64);
     buffer_from_string(&in, (uchar *)from_Alice, N64);
@@ -74,7 +75,7 @@ void CaseAES(const char *client_host, const int client_port){
     buffer_from_base64(&z, &in);
 
     buffer_init(&decrypted, 1);
-    if (!aes_CBC_decrypt(&decrypted, &z, &key, 's')) {
+    if (!channel_decrypt(&decrypted, &z, &key, cipher)) {
         network_send(client_host, client_port, server_host, server_port, "AES: [FAILED]");
     }
     else {
@@ -499,8 +500,8 @@ int main(int argc, char *argv[])
             }
             printf("RECV: %s\n", mesg);
             fflush(stdout);
-            if(strlen(mesg) >= 3 && strncmp(mesg, "AES", 3) == 0){
-                CaseAES(client_host, client_port);
+            if(channel_cipher(mesg) >= 0){
+                CaseAES(client_host, client_port, channel_cipher(mesg));
             }
             else if(strlen(mesg) > 3 && strncmp(mesg, "DH: ", 4) == 0)
                 CaseDH(client_host, client_port, mesg);
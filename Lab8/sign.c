@@ -147,10 +147,9 @@ void RSA_sign(const char* file_name, const char* key_file_name,
     buffer_t msg;
     mpz_t N, d, signature;
     mpz_inits(N, d, signature, NULL);
-    buffer_init(&msg, 100);
 
-    // 2. Import the message in a buffer
-    buffer_from_file(&msg, file_name);
+    // 2. Map the message in a buffer
+    buffer_map_file(&msg, file_name);
 	
     // 3. Parse the secret key
     RSA_key_import(N, d, key_file_name);
@@ -174,12 +173,11 @@ int RSA_verify(const char* file_name, const char* key_file_name,
     // 1. Initialisation
     buffer_t msg;
     mpz_t N, e, S;	
-    buffer_init(&msg, 100);
     mpz_inits(N, e, S, NULL);	
 
 	
-    // 2. Import the message into a buffer
-    buffer_from_file(&msg, file_name);
+    // 2. Map the message into a buffer
+    buffer_map_file(&msg, file_name);
 
     // 3. Import the public key
     RSA_key_import(N, e, key_file_name);
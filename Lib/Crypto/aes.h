@@ -8,15 +8,47 @@
 #define LARGE 256
 #define BYTE_SIZE 8
 
+#include <stdint.h>
+
 #ifndef uint
 typedef unsigned int uint;
 #endif
 
+/* Maximal number of rounds and of words of an expanded key */
+#define AES_MAX_ROUNDS 14
+#define AES_MAX_SCHEDULE (4 * (AES_MAX_ROUNDS + 1))
+
+/* Expanded key: computed once, then used for as many blocks as needed */
+typedef struct{
+    uint w[AES_MAX_SCHEDULE]; /* round keys w[0..4 * (Nr + 1)[ */
+    uint dw[AES_MAX_SCHEDULE]; /* same for the equivalent inverse cipher */
+    int keysize;              /* 128, 192 or 256 */
+    int Nr;                   /* number of rounds */
+    int ni;                   /* 1 if the AES-NI round keys below are used */
+    uchar ni_ek[4 * AES_MAX_SCHEDULE];
+    uchar ni_dk[4 * AES_MAX_SCHEDULE];
+    int bs;                   /* 1 if batches go through the bitsliced keys */
+    uint64_t bs_rk[4 * AES_MAX_SCHEDULE];
+} aes_ctx_t;
+
 /* Functions */
 void aes_key_generation(buffer_t *key, int byte_length);
 void aes_block_encrypt_few_rounds(buffer_t *out, buffer_t *in, buffer_t *key, int Nr);
 void aes_block_encrypt(buffer_t *out, buffer_t *in, buffer_t *key);
 void aes_block_decrypt(buffer_t *out, buffer_t *in, buffer_t *key);
 
+/* Same with a pre-expanded key */
+const char *aes_engine(void);
+int aes_ctx_init(aes_ctx_t *ctx, buffer_t *key);
+void aes_ctx_clear(aes_ctx_t *ctx);
+void aes_ctx_encrypt(aes_ctx_t *ctx, uchar out[], uchar in[]);
+void aes_ctx_decrypt(aes_ctx_t *ctx, uchar out[], uchar in[]);
+void aes_encrypt_blocks(aes_ctx_t *ctx, uchar out[], uchar in[], size_t n);
+void aes_decrypt_blocks(aes_ctx_t *ctx, uchar out[], uchar in[], size_t n);
+void aes_ctx_encrypt_rounds(aes_ctx_t *ctx, uchar states[], uchar in[]);
+void aes_block_encrypt_few_rounds_ctx(buffer_t *out, buffer_t *in, aes_ctx_t *ctx, int Nr);
+void aes_block_encrypt_ctx(buffer_t *out, buffer_t *in, aes_ctx_t *ctx);
+void aes_block_decrypt_ctx(buffer_t *out, buffer_t *in, aes_ctx_t *ctx);
+
 #define __FRS__AES
 #endif
@@ -0,0 +1,455 @@
+/**************************************************************/
+/* aes_bitslice.c                                             */
+/* Bitsliced AES: 8 blocks are encrypted at once and no table */
+/* is indexed by secret data, hence no cache timing leak.     */
+/*                                                            */
+/* Layout: the state of 8 blocks is cut in 8 bit planes. In   */
+/* plane i, the byte k of word h holds the bit i of the state */
+/* byte 8 * h + k of the 8 blocks (bit b for block b). Plane i*/
+/* is q[i] (bytes 0..7, columns 0 and 1) and q[8 + i] (bytes  */
+/* 8..15, columns 2 and 3), so that a column is a 32-bit lane.*/
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "aes.h"
+#include "aes_bitslice.h"
+
+// S-box as the 113 gates circuit of J. Boyar and R. Peralta, "A new combinational
+// logic minimization technique with applications to cryptology" (eprint 2009/191).
+// q[0..7] are the bit planes, q[0] being the least significant bit.
+static void bs_sbox(uint64_t *q)
+{
+   uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+   uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+   uint64_t y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+   uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11;
+   uint64_t z12, z13, z14, z15, z16, z17;
+   uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12;
+   uint64_t t13, t14, t15, t16, t17, t18, t19, t20, t21, t22, t23;
+   uint64_t t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34;
+   uint64_t t35, t36, t37, t38, t39, t40, t41, t42, t43, t44, t45;
+   uint64_t t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56;
+   uint64_t t57, t58, t59, t60, t61, t62, t63, t64, t65, t66, t67;
+   uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+   // The circuit numbers bits from the most significant one
+   x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+   x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+   // Top linear transformation
+   y14 = x3 ^ x5;
+   y13 = x0 ^ x6;
+   y9 = x0 ^ x3;
+   y8 = x0 ^ x5;
+   t0 = x1 ^ x2;
+   y1 = t0 ^ x7;
+   y4 = y1 ^ x3;
+   y12 = y13 ^ y14;
+   y2 = y1 ^ x0;
+   y5 = y1 ^ x6;
+   y3 = y5 ^ y8;
+   t1 = x4 ^ y12;
+   y15 = t1 ^ x5;
+   y20 = t1 ^ x1;
+   y6 = y15 ^ x7;
+   y10 = y15 ^ t0;
+   y11 = y20 ^ y9;
+   y7 = x7 ^ y11;
+   y17 = y10 ^ y11;
+   y19 = y10 ^ y8;
+   y16 = t0 ^ y11;
+   y21 = y13 ^ y16;
+   y18 = x0 ^ y16;
+
+   // Non-linear section: inversion in GF(2^8)
+   t2 = y12 & y15;
+   t3 = y3 & y6;
+   t4 = t3 ^ t2;
+   t5 = y4 & x7;
+   t6 = t5 ^ t2;
+   t7 = y13 & y16;
+   t8 = y5 & y1;
+   t9 = t8 ^ t7;
+   t10 = y2 & y7;
+   t11 = t10 ^ t7;
+   t12 = y9 & y11;
+   t13 = y14 & y17;
+   t14 = t13 ^ t12;
+   t15 = y8 & y10;
+   t16 = t15 ^ t12;
+   t17 = t4 ^ t14;
+   t18 = t6 ^ t16;
+   t19 = t9 ^ t14;
+   t20 = t11 ^ t16;
+   t21 = t17 ^ y20;
+   t22 = t18 ^ y19;
+   t23 = t19 ^ y21;
+   t24 = t20 ^ y18;
+
+   t25 = t21 ^ t22;
+   t26 = t21 & t23;
+   t27 = t24 ^ t26;
+   t28 = t25 & t27;
+   t29 = t28 ^ t22;
+   t30 = t23 ^ t24;
+   t31 = t22 ^ t26;
+   t32 = t31 & t30;
+   t33 = t32 ^ t24;
+   t34 = t23 ^ t33;
+   t35 = t27 ^ t33;
+   t36 = t24 & t35;
+   t37 = t36 ^ t34;
+   t38 = t27 ^ t36;
+   t39 = t29 & t38;
+   t40 = t25 ^ t39;
+
+   t41 = t40 ^ t37;
+   t42 = t29 ^ t33;
+   t43 = t29 ^ t40;
+   t44 = t33 ^ t37;
+   t45 = t42 ^ t41;
+   z0 = t44 & y15;
+   z1 = t37 & y6;
+   z2 = t33 & x7;
+   z3 = t43 & y16;
+   z4 = t40 & y1;
+   z5 = t29 & y7;
+   z6 = t42 & y11;
+   z7 = t45 & y17;
+   z8 = t41 & y10;
+   z9 = t44 & y12;
+   z10 = t37 & y3;
+   z11 = t33 & y4;
+   z12 = t43 & y13;
+   z13 = t40 & y5;
+   z14 = t29 & y2;
+   z15 = t42 & y9;
+   z16 = t45 & y14;
+   z17 = t41 & y8;
+
+   // Bottom linear transformation
+   t46 = z15 ^ z16;
+   t47 = z10 ^ z11;
+   t48 = z5 ^ z13;
+   t49 = z9 ^ z10;
+   t50 = z2 ^ z12;
+   t51 = z2 ^ z5;
+   t52 = z7 ^ z8;
+   t53 = z0 ^ z3;
+   t54 = z6 ^ z7;
+   t55 = z16 ^ z17;
+   t56 = z12 ^ t48;
+   t57 = t50 ^ t53;
+   t58 = z4 ^ t46;
+   t59 = z3 ^ t54;
+   t60 = t46 ^ t57;
+   t61 = z14 ^ t57;
+   t62 = t52 ^ t58;
+   t63 = t49 ^ t58;
+   t64 = z4 ^ t59;
+   t65 = t61 ^ t62;
+   t66 = z1 ^ t63;
+   s0 = t59 ^ t63;
+   s6 = t56 ^ ~t62;
+   s7 = t48 ^ ~t60;
+   t67 = t64 ^ t65;
+   s3 = t53 ^ t66;
+   s4 = t51 ^ t66;
+   s5 = t47 ^ t65;
+   s1 = t64 ^ ~s3;
+   s2 = t55 ^ ~t67;
+
+   q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+   q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+// Inverse of the affine map of the S-box, S^-1(y) = A^-1(S(A^-1(y))).
+static void bs_inv_affine(uint64_t *q)
+{
+   uint64_t y[8];
+   int i;
+   for (i = 0; i < 8; i++)
+      y[i] = q[i];
+   for (i = 0; i < 8; i++)
+      q[i] = y[(i + 2) & 7] ^ y[(i + 5) & 7] ^ y[(i + 7) & 7];
+   // constant 0x05
+   q[0] = ~q[0];
+   q[2] = ~q[2];
+}
+
+static void bs_inv_sbox(uint64_t *q)
+{
+   bs_inv_affine(q);
+   bs_sbox(q);
+   bs_inv_affine(q);
+}
+
+/********************
+** Conversions
+********************/
+
+// Transposes the 8x8 bit matrix whose rows are the bytes of x.
+static uint64_t transpose8(uint64_t x)
+{
+   uint64_t t;
+   t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+   x = x ^ t ^ (t << 7);
+   t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+   x = x ^ t ^ (t << 14);
+   t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+   x = x ^ t ^ (t << 28);
+   return x;
+}
+
+// n <= 8 blocks from in to the planes, missing blocks are zero.
+static void bs_load(uint64_t q[16], uchar in[], size_t n)
+{
+   uint64_t x;
+   size_t b;
+   int i, j;
+   memset(q, 0, 16 * sizeof(uint64_t));
+   for (j = 0; j < BLOCK_LENGTH; j++) {
+      x = 0;
+      for (b = 0; b < n; b++)
+         x |= (uint64_t)in[BLOCK_LENGTH * b + j] << (8 * b);
+      x = transpose8(x);
+      for (i = 0; i < 8; i++)
+         q[8 * (j >> 3) + i] |= ((x >> (8 * i)) & 0xFF) << (8 * (j & 7));
+   }
+}
+
+static void bs_store(uchar out[], uint64_t q[16], size_t n)
+{
+   uint64_t x;
+   size_t b;
+   int i, j;
+   for (j = 0; j < BLOCK_LENGTH; j++) {
+      x = 0;
+      for (i = 0; i < 8; i++)
+         x |= ((q[8 * (j >> 3) + i] >> (8 * (j & 7))) & 0xFF) << (8 * i);
+      x = transpose8(x);
+      for (b = 0; b < n; b++)
+         out[BLOCK_LENGTH * b + j] = (uchar)(x >> (8 * b));
+   }
+}
+
+/********************
+** Rounds
+********************/
+
+static void bs_add_round_key(uint64_t q[16], uint64_t rk[16])
+{
+   int i;
+   for (i = 0; i < 16; i++)
+      q[i] ^= rk[i];
+}
+
+// Row r of the state is the byte r of each 32-bit lane. ShiftRows rotates row r
+// by r columns, i.e. the 128-bit plane (q[i], q[8 + i]) by 32 * r bits.
+#define ROW(r) (0x000000FF000000FFULL << (8 * (r)))
+
+static void bs_shift_rows(uint64_t q[16], int inverse)
+{
+   uint64_t lo, hi, l1, h1, l2, h2, l3, h3;
+   int i;
+   for (i = 0; i < 8; i++) {
+      lo = q[i];
+      hi = q[8 + i];
+      l1 = lo & ROW(1); h1 = hi & ROW(1);
+      l2 = lo & ROW(2); h2 = hi & ROW(2);
+      l3 = lo & ROW(3); h3 = hi & ROW(3);
+      if (inverse) {
+         q[i] = (lo & ROW(0)) | (l1 << 32) | (h1 >> 32) | h2 | (l3 >> 32) | (h3 << 32);
+         q[8 + i] = (hi & ROW(0)) | (h1 << 32) | (l1 >> 32) | l2 | (h3 >> 32) | (l3 << 32);
+      }
+      else {
+         q[i] = (lo & ROW(0)) | (l1 >> 32) | (h1 << 32) | h2 | (l3 << 32) | (h3 >> 32);
+         q[8 + i] = (hi & ROW(0)) | (h1 >> 32) | (l1 << 32) | l2 | (h3 << 32) | (l3 >> 32);
+      }
+   }
+}
+
+// Row r receives row r + 1, resp. r + 2, in every column
+#define ROT1(x) ((((x) >> 8) & 0x00FFFFFF00FFFFFFULL) | (((x) << 24) & 0xFF000000FF000000ULL))
+#define ROT2(x) ((((x) >> 16) & 0x0000FFFF0000FFFFULL) | (((x) << 16) & 0xFFFF0000FFFF0000ULL))
+
+// Multiplication by 0x02 of the 8 planes a[0..7] (a[0] is the lowest bit).
+static void bs_xtime(uint64_t d[8], uint64_t a[8])
+{
+   uint64_t hb = a[7];
+   d[7] = a[6];
+   d[6] = a[5];
+   d[5] = a[4];
+   d[4] = a[3] ^ hb;
+   d[3] = a[2] ^ hb;
+   d[2] = a[1];
+   d[1] = a[0] ^ hb;
+   d[0] = hb;
+}
+
+// out = 02 * (a + R a) + R a + R^2 (a + R a), R being the rotation of the rows.
+static void bs_mix_columns(uint64_t q[16])
+{
+   uint64_t *a, t[8], d[8];
+   int h, i;
+   for (h = 0; h < 2; h++) {
+      a = q + 8 * h;
+      for (i = 0; i < 8; i++)
+         t[i] = a[i] ^ ROT1(a[i]);
+      bs_xtime(d, t);
+      for (i = 0; i < 8; i++)
+         a[i] = d[i] ^ ROT1(a[i]) ^ ROT2(t[i]);
+   }
+}
+
+// InvMixColumns(a) = MixColumns(a + 04 * (a + R^2 a)).
+static void bs_inv_mix_columns(uint64_t q[16])
+{
+   uint64_t *a, t[8], d[8];
+   int h, i;
+   for (h = 0; h < 2; h++) {
+      a = q + 8 * h;
+      for (i = 0; i < 8; i++)
+         t[i] = a[i] ^ ROT2(a[i]);
+      bs_xtime(d, t);
+      bs_xtime(t, d);
+      for (i = 0; i < 8; i++)
+         a[i] ^= t[i];
+   }
+   bs_mix_columns(q);
+}
+
+/********************
+** KEY EXPANSION
+********************/
+
+// SubWord without lookup: the 4 bytes go in 4 lanes of the planes.
+static uint bs_sub_word(uint word)
+{
+   uint64_t q[8];
+   uint result = 0;
+   int i, k;
+   for (i = 0; i < 8; i++) {
+      q[i] = 0;
+      for (k = 0; k < 4; k++)
+         q[i] |= (uint64_t)((word >> (8 * k + i)) & 1) << k;
+   }
+   bs_sbox(q);
+   for (i = 0; i < 8; i++)
+      for (k = 0; k < 4; k++)
+         result |= (uint)((q[i] >> k) & 1) << (8 * k + i);
+   return result;
+}
+
+// Same as KeyExpansion() in aes.c, with a constant time SubWord.
+void aes_bs_key_expansion(uint w[], uchar key[], int keysize)
+{
+   int Nr, Nk, idx;
+   uint temp, Rcon[] = {0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+                        0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000};
+   switch (keysize) {
+      case 128: Nr = 10; Nk = 4; break;
+      case 192: Nr = 12; Nk = 6; break;
+      case 256: Nr = 14; Nk = 8; break;
+      default: return;
+   }
+
+   for (idx = 0; idx < Nk; ++idx) {
+      w[idx] = ((uint)key[4 * idx] << 24) | ((uint)key[4 * idx + 1] << 16) |
+               ((uint)key[4 * idx + 2] << 8) | ((uint)key[4 * idx + 3]);
+   }
+
+   for (idx = Nk; idx < 4 * (Nr + 1); ++idx) {
+      temp = w[idx - 1];
+      if ((idx % Nk) == 0)
+         temp = bs_sub_word((temp << 8) | (temp >> 24)) ^ Rcon[(idx - 1) / Nk];
+      else if (Nk > 6 && (idx % Nk) == 4)
+         temp = bs_sub_word(temp);
+      w[idx] = w[idx - Nk] ^ temp;
+   }
+}
+
+// Spreads each bit of the schedule w over the 8 blocks: rk[16 * r + 8 * h + i]
+// has byte k equal to 0xFF iff bit i of byte 8 * h + k of round key r is set.
+void aes_bs_round_keys(uint64_t rk[], uint w[], int Nr)
+{
+   uint64_t bit;
+   int r, i, j;
+   uchar byte;
+   memset(rk, 0, 16 * (Nr + 1) * sizeof(uint64_t));
+   for (r = 0; r <= Nr; r++)
+      for (j = 0; j < BLOCK_LENGTH; j++) {
+         byte = (uchar)(w[4 * r + j / 4] >> (24 - 8 * (j % 4)));
+         for (i = 0; i < 8; i++) {
+            bit = (uint64_t)((byte >> i) & 1);
+            rk[16 * r + 8 * (j >> 3) + i] |= (0xFF * bit) << (8 * (j & 7));
+         }
+      }
+}
+
+/********************
+** AES (En/De)Crypt
+********************/
+
+// n blocks of BLOCK_LENGTH bytes, processed by groups of AES_BS_BLOCKS.
+// out may be equal to in.
+void aes_bs_encrypt_blocks(uint64_t rk[], int Nr, uchar out[], uchar in[], size_t n)
+{
+   uint64_t q[16];
+   size_t m;
+   int r;
+   while (n > 0) {
+      m = n < AES_BS_BLOCKS ? n : AES_BS_BLOCKS;
+      bs_load(q, in, m);
+      bs_add_round_key(q, rk);
+      for (r = 1; r < Nr; r++) {
+         bs_sbox(q);
+         bs_sbox(q + 8);
+         bs_shift_rows(q, 0);
+         bs_mix_columns(q);
+         bs_add_round_key(q, rk + 16 * r);
+      }
+      bs_sbox(q);
+      bs_sbox(q + 8);
+      bs_shift_rows(q, 0);
+      bs_add_round_key(q, rk + 16 * Nr);
+      bs_store(out, q, m);
+      in += BLOCK_LENGTH * m;
+      out += BLOCK_LENGTH * m;
+      n -= m;
+   }
+   memset(q, 0, sizeof(q));
+}
+
+void aes_bs_decrypt_blocks(uint64_t rk[], int Nr, uchar out[], uchar in[], size_t n)
+{
+   uint64_t q[16];
+   size_t m;
+   int r;
+   while (n > 0) {
+      m = n < AES_BS_BLOCKS ? n : AES_BS_BLOCKS;
+      bs_load(q, in, m);
+      bs_add_round_key(q, rk + 16 * Nr);
+      for (r = Nr - 1; r > 0; r--) {
+         bs_shift_rows(q, 1);
+         bs_inv_sbox(q);
+         bs_inv_sbox(q + 8);
+         bs_add_round_key(q, rk + 16 * r);
+         bs_inv_mix_columns(q);
+      }
+      bs_shift_rows(q, 1);
+      bs_inv_sbox(q);
+      bs_inv_sbox(q + 8);
+      bs_add_round_key(q, rk);
+      bs_store(out, q, m);
+      in += BLOCK_LENGTH * m;
+      out += BLOCK_LENGTH * m;
+      n -= m;
+   }
+   memset(q, 0, sizeof(q));
+}
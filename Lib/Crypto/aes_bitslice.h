@@ -0,0 +1,28 @@
+#ifndef __FRS__AES_BITSLICE
+
+/**************************************************************/
+/* aes_bitslice.h                                             */
+/* Constant time AES on 8 blocks at once                      */
+/**************************************************************/
+
+#include <stdint.h>
+
+/* Set AES_BITSLICE to 0 to use the table engine for batches too */
+#ifndef AES_BITSLICE
+#define AES_BITSLICE 1
+#endif
+
+/* Blocks handled by one pass */
+#define AES_BS_BLOCKS 8
+
+/* 16 words per round key: 8 bit planes, 2 halves of the state */
+#define AES_BS_SCHEDULE (16 * 15)
+
+/* Functions */
+void aes_bs_key_expansion(uint w[], uchar key[], int keysize);
+void aes_bs_round_keys(uint64_t rk[], uint w[], int Nr);
+void aes_bs_encrypt_blocks(uint64_t rk[], int Nr, uchar out[], uchar in[], size_t n);
+void aes_bs_decrypt_blocks(uint64_t rk[], int Nr, uchar out[], uchar in[], size_t n);
+
+#define __FRS__AES_BITSLICE
+#endif
@@ -0,0 +1,229 @@
+/**************************************************************/
+/* aes_ni.c                                                   */
+/* AES with the x86 AES-NI instructions.                      */
+/* The round keys are the bytes of the FIPS-197 schedule, 16  */
+/* per round; the decryption keys are those of the equivalent */
+/* inverse cipher (InvMixColumns applied, reverse order).     */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "aes_ni.h"
+
+#if AES_NI
+
+#include <cpuid.h>
+
+#pragma GCC push_options
+#pragma GCC target("aes,sse2")
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+/* 1 if the processor has AES-NI, computed on first call. */
+int aes_ni_available(void){
+    static int available = -1;
+    unsigned int a, b, c, d;
+    if(available < 0){
+	if(__get_cpuid(1, &a, &b, &c, &d) == 0)
+	    available = 0;
+	else
+	    available = (c & bit_AES) != 0 && (d & bit_SSE2) != 0;
+    }
+    return available;
+}
+
+
+/********************
+** KEY EXPANSION
+********************/
+
+/* Intel, "Advanced Encryption Standard (AES) New Instructions Set",
+   white paper 323641, section 5. */
+
+/* t2 = aeskeygenassist(previous round key, rcon) */
+static __m128i assist_128(__m128i t1, __m128i t2){
+    __m128i t3;
+    t2 = _mm_shuffle_epi32(t2, 0xff);
+    t3 = _mm_slli_si128(t1, 4);
+    t1 = _mm_xor_si128(t1, t3);
+    t3 = _mm_slli_si128(t3, 4);
+    t1 = _mm_xor_si128(t1, t3);
+    t3 = _mm_slli_si128(t3, 4);
+    t1 = _mm_xor_si128(t1, t3);
+    return _mm_xor_si128(t1, t2);
+}
+
+static void assist_192(__m128i *t1, __m128i *t2, __m128i *t3){
+    __m128i t4;
+    *t2 = _mm_shuffle_epi32(*t2, 0x55);
+    t4 = _mm_slli_si128(*t1, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    *t1 = _mm_xor_si128(*t1, *t2);
+    *t2 = _mm_shuffle_epi32(*t1, 0xff);
+    t4 = _mm_slli_si128(*t3, 4);
+    *t3 = _mm_xor_si128(*t3, t4);
+    *t3 = _mm_xor_si128(*t3, *t2);
+}
+
+/* Second half of a 256-bit step: SubWord without RotWord nor rcon */
+static __m128i assist_256(__m128i t1, __m128i t3){
+    __m128i t2, t4;
+    t4 = _mm_aeskeygenassist_si128(t1, 0x00);
+    t2 = _mm_shuffle_epi32(t4, 0xaa);
+    t4 = _mm_slli_si128(t3, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    return _mm_xor_si128(t3, t2);
+}
+
+/* Lower half of a, lower half of b */
+#define LOW_LOW(a, b) _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), \
+						    _mm_castsi128_pd(b), 0))
+/* Upper half of a, lower half of b */
+#define HIGH_LOW(a, b) _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), \
+						     _mm_castsi128_pd(b), 1))
+
+static int expand_128(__m128i k[], uchar key[]){
+    __m128i t = _mm_loadu_si128((__m128i *)key);
+    k[0] = t;
+#define STEP_128(i, rcon) \
+    t = assist_128(t, _mm_aeskeygenassist_si128(t, rcon)); k[i] = t;
+    STEP_128(1, 0x01); STEP_128(2, 0x02); STEP_128(3, 0x04);
+    STEP_128(4, 0x08); STEP_128(5, 0x10); STEP_128(6, 0x20);
+    STEP_128(7, 0x40); STEP_128(8, 0x80); STEP_128(9, 0x1b);
+    STEP_128(10, 0x36);
+#undef STEP_128
+    return 10;
+}
+
+static int expand_192(__m128i k[], uchar key[]){
+    __m128i t1, t2, t3;
+    t1 = _mm_loadu_si128((__m128i *)key);
+    t3 = _mm_loadl_epi64((__m128i *)(key + 16));
+    k[0] = t1;
+    k[1] = t3;
+    /* Each pair of steps produces 3 round keys out of 6 words */
+#define STEP_192(i, rcon1, rcon2) \
+    t2 = _mm_aeskeygenassist_si128(t3, rcon1); \
+    assist_192(&t1, &t2, &t3); \
+    k[i] = LOW_LOW(k[i], t1); \
+    k[i + 1] = HIGH_LOW(t1, t3); \
+    t2 = _mm_aeskeygenassist_si128(t3, rcon2); \
+    assist_192(&t1, &t2, &t3); \
+    k[i + 2] = t1; \
+    k[i + 3] = t3;
+    STEP_192(1, 0x01, 0x02);
+    STEP_192(4, 0x04, 0x08);
+    STEP_192(7, 0x10, 0x20);
+    t2 = _mm_aeskeygenassist_si128(t3, 0x40);
+    assist_192(&t1, &t2, &t3);
+    k[10] = LOW_LOW(k[10], t1);
+    k[11] = HIGH_LOW(t1, t3);
+    t2 = _mm_aeskeygenassist_si128(t3, 0x80);
+    assist_192(&t1, &t2, &t3);
+    k[12] = t1;
+#undef STEP_192
+    return 12;
+}
+
+static int expand_256(__m128i k[], uchar key[]){
+    __m128i t1, t3;
+    t1 = _mm_loadu_si128((__m128i *)key);
+    t3 = _mm_loadu_si128((__m128i *)(key + 16));
+    k[0] = t1;
+    k[1] = t3;
+#define STEP_256(i, rcon) \
+    t1 = assist_128(t1, _mm_aeskeygenassist_si128(t3, rcon)); k[i] = t1; \
+    t3 = assist_256(t1, t3); k[i + 1] = t3;
+    STEP_256(2, 0x01); STEP_256(4, 0x02); STEP_256(6, 0x04);
+    STEP_256(8, 0x08); STEP_256(10, 0x10); STEP_256(12, 0x20);
+#undef STEP_256
+    t1 = assist_128(t1, _mm_aeskeygenassist_si128(t3, 0x40));
+    k[14] = t1;
+    return 14;
+}
+
+
+/* ek and dk receive 16 * (Nr + 1) bytes. keysize is 128, 192 or 256. */
+void aes_ni_key_expansion(uchar ek[], uchar dk[], uchar key[], int keysize){
+    __m128i k[15];
+    int i, Nr;
+    switch(keysize){
+    case 128: Nr = expand_128(k, key); break;
+    case 192: Nr = expand_192(k, key); break;
+    case 256: Nr = expand_256(k, key); break;
+    default: return;
+    }
+    for(i = 0; i <= Nr; i++)
+	_mm_storeu_si128((__m128i *)(ek + 16 * i), k[i]);
+    _mm_storeu_si128((__m128i *)dk, k[Nr]);
+    for(i = 1; i < Nr; i++)
+	_mm_storeu_si128((__m128i *)(dk + 16 * i), _mm_aesimc_si128(k[Nr - i]));
+    _mm_storeu_si128((__m128i *)(dk + 16 * Nr), k[0]);
+    for(i = 0; i <= Nr; i++)
+	k[i] = _mm_setzero_si128();
+}
+
+
+/********************
+** (En/De)Crypt
+********************/
+
+/* Blocks are processed 8, then 4 at a time so that the latency of
+   aesenc/aesdec is hidden by independent blocks. */
+#define INTERLEAVE 8
+
+#define AES_NI_BLOCKS(name, round, last)				\
+void name(uchar rk[], int Nr, uchar out[], uchar in[], size_t n){	\
+    __m128i k[15], b[INTERLEAVE];					\
+    int i, r, w;							\
+    for(r = 0; r <= Nr; r++)						\
+	k[r] = _mm_loadu_si128((__m128i *)(rk + 16 * r));		\
+    while(n > 0){							\
+	w = n >= 8 ? 8 : (n >= 4 ? 4 : 1);				\
+	for(i = 0; i < w; i++)						\
+	    b[i] = _mm_xor_si128(_mm_loadu_si128((__m128i *)(in + 16 * i)), \
+				 k[0]);					\
+	for(r = 1; r < Nr; r++)						\
+	    for(i = 0; i < w; i++)					\
+		b[i] = round(b[i], k[r]);				\
+	for(i = 0; i < w; i++)						\
+	    _mm_storeu_si128((__m128i *)(out + 16 * i), last(b[i], k[Nr])); \
+	in += 16 * w;							\
+	out += 16 * w;							\
+	n -= w;								\
+    }									\
+}
+
+/* out may be equal to in */
+AES_NI_BLOCKS(aes_ni_encrypt_blocks, _mm_aesenc_si128, _mm_aesenclast_si128)
+AES_NI_BLOCKS(aes_ni_decrypt_blocks, _mm_aesdec_si128, _mm_aesdeclast_si128)
+
+#pragma GCC pop_options
+
+#else
+
+int aes_ni_available(void){
+    return 0;
+}
+
+void aes_ni_key_expansion(uchar ek[], uchar dk[], uchar key[], int keysize){
+}
+
+void aes_ni_encrypt_blocks(uchar ek[], int Nr, uchar out[], uchar in[], size_t n){
+}
+
+void aes_ni_decrypt_blocks(uchar dk[], int Nr, uchar out[], uchar in[], size_t n){
+}
+
+#endif
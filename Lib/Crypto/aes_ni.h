@@ -0,0 +1,24 @@
+#ifndef __FRS__AES_NI
+
+/**************************************************************/
+/* aes_ni.h                                                   */
+/* AES with the x86 AES-NI instructions, chosen at run time   */
+/**************************************************************/
+
+/* Set AES_NI to 0 to build without the hardware backend */
+#ifndef AES_NI
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AES_NI 1
+#else
+#define AES_NI 0
+#endif
+#endif
+
+/* Functions */
+int aes_ni_available(void);
+void aes_ni_key_expansion(uchar ek[], uchar dk[], uchar key[], int keysize);
+void aes_ni_encrypt_blocks(uchar ek[], int Nr, uchar out[], uchar in[], size_t n);
+void aes_ni_decrypt_blocks(uchar dk[], int Nr, uchar out[], uchar in[], size_t n);
+
+#define __FRS__AES_NI
+#endif
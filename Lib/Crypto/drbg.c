@@ -0,0 +1,101 @@
+/**************************************************************/
+/* drbg.c                                                     */
+/* Deterministic random bit generator : the seed is absorbed  */
+/* by SHAKE256 and the output squeezed out. Each thread owns  */
+/* its generator, so that no lock is taken.                   */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "random.h"
+#include "sha3.h"
+#include "drbg.h"
+
+#define DRBG_SEED_LENGTH 64
+
+typedef struct{
+    sha3_ctx_t sponge; /* squeezing */
+    int seeded;
+} drbg_t;
+
+static __thread drbg_t drbg;
+
+
+static void drbg_absorb(drbg_t *g, const void *seed, size_t len){
+    static const char domain[] = "inf558 SHAKE256 DRBG";
+    shake256_init(&g->sponge);
+    shake_update(&g->sponge, domain, sizeof(domain) - 1);
+    shake_update(&g->sponge, seed, len);
+    shake_xof(&g->sponge);
+    g->seeded = 1;
+}
+
+
+/* First use in a thread : seed from the system */
+static drbg_t *drbg_get(void){
+    if(!drbg.seeded){
+	uint8_t seed[DRBG_SEED_LENGTH];
+	if(!random_entropy(seed, sizeof(seed))){
+	    perror("[drbg] : No system randomness, seeding with the time.\n");
+	    uint64_t t = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&drbg;
+	    memcpy(seed, &t, sizeof(t));
+	}
+	drbg_absorb(&drbg, seed, sizeof(seed));
+	memset(seed, 0, sizeof(seed));
+    }
+    return &drbg;
+}
+
+
+/* The rate is zeroed before one more permutation (the sponge "forget"),
+   so that the state left behind does not give back what was output */
+static void drbg_forget(drbg_t *g){
+    memset(g->sponge.st.b, 0, g->sponge.rsiz);
+    sha3_keccakf(g->sponge.st.q);
+    g->sponge.pt = 0;
+}
+
+
+void drbg_bytes(void *out, size_t len){
+    drbg_t *g = drbg_get();
+    shake_out(&g->sponge, out, len);
+    drbg_forget(g);
+}
+
+
+/* For simulations : no forget, the next 8 bytes of the stream */
+uint64_t drbg_u64(void){
+    uint64_t x;
+    shake_out(&drbg_get()->sponge, &x, sizeof(x));
+    return x;
+}
+
+
+void drbg_seed(const void *seed, size_t len){
+    drbg_absorb(&drbg, seed, len);
+}
+
+
+void drbg_seed_ui(unsigned long seed){
+    uint8_t s[8];
+    for(int i = 0; i < 8; i++)
+	s[i] = (uint8_t)((uint64_t)seed >> (8 * i));
+    drbg_seed(s, sizeof(s));
+}
+
+
+/*! \brief Fills in a buffer with \a byte_length random bytes of the
+  generator of the calling thread */
+void buffer_random(buffer_t *out, int byte_length){
+    buffer_reset(out);
+    if(byte_length <= 0 || buffer_resize(out, byte_length) == 0)
+	return;
+    drbg_bytes(out->tab, byte_length);
+    out->length = byte_length;
+}
@@ -0,0 +1,24 @@
+#ifndef __FRS__DRBG
+
+/**************************************************************/
+/* drbg.h                                                     */
+/* Random bytes squeezed from SHAKE256, one generator per     */
+/* thread, seeded from getrandom() the first time it is used. */
+/* buffer_random() draws from it.                             */
+/**************************************************************/
+
+#include <stdint.h>
+
+/* len random bytes from the generator of the calling thread */
+void drbg_bytes(void *out, size_t len);
+uint64_t drbg_u64(void);
+
+/* out = byte_length random bytes of the same generator; needs buffer.h */
+void buffer_random(buffer_t *out, int byte_length);
+
+/* Reseeds the generator of the calling thread, for reproducible runs */
+void drbg_seed(const void *seed, size_t len);
+void drbg_seed_ui(unsigned long seed);
+
+#define __FRS__DRBG
+#endif
@@ -0,0 +1,233 @@
+/**************************************************************/
+/* ghash.c                                                    */
+/* GHASH: Y <- (Y xor X) * H in GF(2^128) for each block X,   */
+/* with the bit reflected convention of NIST SP 800-38D.      */
+/* The multiplication uses PCLMULQDQ when the processor has   */
+/* it, else the 4-bit tables of Shoup (16 multiples of H).    */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "ghash.h"
+
+#define GETU64(p) (((uint64_t)(p)[0] << 56) ^ ((uint64_t)(p)[1] << 48) ^ \
+		   ((uint64_t)(p)[2] << 40) ^ ((uint64_t)(p)[3] << 32) ^ \
+		   ((uint64_t)(p)[4] << 24) ^ ((uint64_t)(p)[5] << 16) ^ \
+		   ((uint64_t)(p)[6] << 8) ^ ((uint64_t)(p)[7]))
+
+static void PUTU64(uchar p[], uint64_t v){
+    int i;
+    for(i = 7; i >= 0; i--, v >>= 8)
+	p[i] = (uchar)v;
+}
+
+
+/********************
+** 4-BIT TABLES
+********************/
+
+/* Reduction of the 4 bits shifted out, times x^128 mod the GCM polynomial */
+static const uint64_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void table_init(ghash_key_t *key){
+    uint64_t vh = GETU64(key->H), vl = GETU64(key->H + 8), t;
+    int i, j;
+
+    // 1. 8 * H = H, then 4 * H, 2 * H, 1 * H by shifts (reflected bits)
+    key->HH[0] = key->HL[0] = 0;
+    key->HH[8] = vh;
+    key->HL[8] = vl;
+    for(i = 4; i > 0; i >>= 1){
+	t = (vl & 1) * 0xe1000000;
+	vl = (vh << 63) | (vl >> 1);
+	vh = (vh >> 1) ^ (t << 32);
+	key->HH[i] = vh;
+	key->HL[i] = vl;
+    }
+
+    // 2. The other entries by linearity
+    for(i = 2; i <= 8; i *= 2)
+	for(j = 1; j < i; j++){
+	    key->HH[i + j] = key->HH[i] ^ key->HH[j];
+	    key->HL[i + j] = key->HL[i] ^ key->HL[j];
+	}
+}
+
+/* Y <- Y * H, 4 bits at a time from the last byte */
+static void table_mult(ghash_key_t *key, uchar Y[]){
+    uint64_t zh, zl;
+    int i, rem, lo, hi;
+
+    lo = Y[15] & 0xf;
+    zh = key->HH[lo];
+    zl = key->HL[lo];
+    for(i = 15; i >= 0; i--){
+	lo = Y[i] & 0xf;
+	hi = Y[i] >> 4;
+	if(i != 15){
+	    rem = zl & 0xf;
+	    zl = (zh << 60) | (zl >> 4);
+	    zh = (zh >> 4) ^ (last4[rem] << 48) ^ key->HH[lo];
+	    zl ^= key->HL[lo];
+	}
+	rem = zl & 0xf;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ (last4[rem] << 48) ^ key->HH[hi];
+	zl ^= key->HL[hi];
+    }
+    PUTU64(Y, zh);
+    PUTU64(Y + 8, zl);
+}
+
+
+static void table_update(ghash_key_t *key, uchar Y[], uchar in[], size_t length){
+    size_t i, k;
+    while(length > 0){
+	k = length < 16 ? length : 16;
+	for(i = 0; i < k; i++)
+	    Y[i] ^= in[i];
+	table_mult(key, Y);
+	in += k;
+	length -= k;
+    }
+}
+
+
+#if GHASH_CLMUL
+
+#include <cpuid.h>
+
+#pragma GCC push_options
+#pragma GCC target("pclmul,ssse3,sse2")
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#include <emmintrin.h>
+
+/* 1 if the processor has PCLMULQDQ, computed on first call. */
+int ghash_clmul_available(void){
+    static int available = -1;
+    unsigned int a, b, c, d;
+    if(available < 0){
+	if(__get_cpuid(1, &a, &b, &c, &d) == 0)
+	    available = 0;
+	else
+	    available = (c & bit_PCLMUL) != 0 && (c & bit_SSSE3) != 0;
+    }
+    return available;
+}
+
+
+/* Intel, "Intel Carry-Less Multiplication Instruction and its Usage for
+   Computing the GCM Mode", white paper 323640, algorithm 5: a and b are
+   byte reversed, the product is shifted left once to undo the bit
+   reflection, then reduced. */
+static __m128i clmul_mult(__m128i a, __m128i b){
+    __m128i t2, t3, t4, t5, t6, t7, t8, t9;
+    t3 = _mm_clmulepi64_si128(a, b, 0x00);
+    t4 = _mm_clmulepi64_si128(a, b, 0x10);
+    t5 = _mm_clmulepi64_si128(a, b, 0x01);
+    t6 = _mm_clmulepi64_si128(a, b, 0x11);
+    t4 = _mm_xor_si128(t4, t5);
+    t5 = _mm_slli_si128(t4, 8);
+    t4 = _mm_srli_si128(t4, 8);
+    t3 = _mm_xor_si128(t3, t5);
+    t6 = _mm_xor_si128(t6, t4);
+
+    // 1. Shift t6 || t3 left by one bit
+    t7 = _mm_srli_epi32(t3, 31);
+    t8 = _mm_srli_epi32(t6, 31);
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(t6, t8);
+    t6 = _mm_or_si128(t6, t9);
+
+    // 2. Reduction modulo x^128 + x^7 + x^2 + x + 1
+    t7 = _mm_slli_epi32(t3, 31);
+    t8 = _mm_slli_epi32(t3, 30);
+    t9 = _mm_slli_epi32(t3, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+    t2 = _mm_srli_epi32(t3, 1);
+    t4 = _mm_srli_epi32(t3, 2);
+    t5 = _mm_srli_epi32(t3, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    return _mm_xor_si128(t6, t3);
+}
+
+
+static void clmul_update(ghash_key_t *key, uchar Y[], uchar in[], size_t length){
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i h = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)key->H), reverse);
+    __m128i y = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)Y), reverse);
+    uchar last[16];
+
+    for(; length >= 16; length -= 16, in += 16){
+	__m128i x = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)in), reverse);
+	y = clmul_mult(_mm_xor_si128(y, x), h);
+    }
+    if(length > 0){
+	memset(last, 0, 16);
+	memcpy(last, in, length);
+	__m128i x = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)last), reverse);
+	y = clmul_mult(_mm_xor_si128(y, x), h);
+    }
+    _mm_storeu_si128((__m128i *)Y, _mm_shuffle_epi8(y, reverse));
+}
+
+#pragma GCC pop_options
+
+#else
+
+int ghash_clmul_available(void){
+    return 0;
+}
+
+static void clmul_update(ghash_key_t *key, uchar Y[], uchar in[], size_t length){
+}
+
+#endif
+
+
+/********************/
+/* PUBLIC FUNCTIONS */
+/********************/
+
+/* H = AES_K(0^128), 16 bytes */
+void ghash_init(ghash_key_t *key, uchar H[]){
+    memcpy(key->H, H, 16);
+    key->clmul = ghash_clmul_available();
+    if(!key->clmul)
+	table_init(key);
+}
+
+
+/* Y[16] <- GHASH of in[] from Y, the last partial block being padded with 0 */
+void ghash_update(ghash_key_t *key, uchar Y[], uchar in[], size_t length){
+    if(key->clmul)
+	clmul_update(key, Y, in, length);
+    else
+	table_update(key, Y, in, length);
+}
+
+
+void ghash_clear(ghash_key_t *key){
+    memset(key, 0, sizeof(ghash_key_t));
+}
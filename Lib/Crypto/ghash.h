@@ -0,0 +1,34 @@
+#ifndef __FRS__GHASH
+
+/**************************************************************/
+/* ghash.h                                                    */
+/* GHASH, the universal hash of GCM (NIST SP 800-38D)         */
+/**************************************************************/
+
+#include <stdint.h>
+
+/* Set GHASH_CLMUL to 0 to build without the PCLMULQDQ code */
+#ifndef GHASH_CLMUL
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GHASH_CLMUL 1
+#else
+#define GHASH_CLMUL 0
+#endif
+#endif
+
+/* Definitions */
+typedef struct{
+    uint64_t HL[16]; /* 4-bit table : HH[i] || HL[i] = i * H */
+    uint64_t HH[16];
+    uchar H[16];     /* the hash key, AES_K(0^128) */
+    int clmul;       /* 1 if the carry-less multiplication is used */
+} ghash_key_t;
+
+/* Functions */
+int ghash_clmul_available(void);
+void ghash_init(ghash_key_t *key, uchar H[]);
+void ghash_update(ghash_key_t *key, uchar Y[], uchar in[], size_t length);
+void ghash_clear(ghash_key_t *key);
+
+#define __FRS__GHASH
+#endif
@@ -7,11 +7,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "gmp.h"
 #include "base64.h"
 #include "buffer.h"
 #include "bits.h"
+#include "parallel.h"
 #include "aes.h"
 #include "sha3.h"
 #include "operating_modes.h"
@@ -26,19 +28,16 @@ void pad(buffer_t *padded, buffer_t *in, char mode){
 	return;
     }
 
-    buffer_append(padded, in);
+    size_t a = BLOCK_LENGTH - in->length % BLOCK_LENGTH;
+    if(buffer_set_length(padded, in->length + a) == 0)
+	return;
+    memcpy(padded->tab, in->tab, in->length);
     if(mode == 's'){
-	buffer_append_uchar(padded, (1 << (BYTE_SIZE - 1)));
-	int a = (int)(BLOCK_LENGTH - (in->length) % BLOCK_LENGTH), i;
-	for(i = 0; i < a - 1; i++)
-	    buffer_append_uchar(padded, 0);
-    }
-    if(mode == 'R'){
-	uchar a = (uchar)(BLOCK_LENGTH - (in->length % BLOCK_LENGTH));
-	int i;
-	for(i = 0; i < a; i++)
-	    buffer_append_uchar(padded, a);
+	padded->tab[in->length] = 1 << (BYTE_SIZE - 1);
+	memset(padded->tab + in->length + 1, 0, a - 1);
     }
+    if(mode == 'R')
+	memset(padded->tab + in->length, (int)a, a);
 #if DEBUG
     printf("[pad]: length of padded: %d.\tLength of padded mod %d: %d\n",
 	   (int)(padded->length), BLOCK_LENGTH,
@@ -78,63 +77,181 @@ void extract(buffer_t *out, buffer_t *padded, char mode){
 	perror("[pad] ERROR: mode should be either 's' or 'R' (''standard'' or ''RFC202'') \n");
 	return;
     }
-    cursor = padded->tab;
+    buffer_append_bytes(out, padded->tab, l);
+}
+
+/**********************************************************/
+/* Work on independent blocks (CBC decryption, CTR) : the */
+/* input is cut into chunks of whole blocks, one for each */
+/* thread.                                                */
+/**********************************************************/
+
+typedef struct{
+    aes_ctx_t *ctx;
+    uchar *IV;     /* initial counter for CTR */
+    uchar *out;
+    uchar *in;
+    size_t first;  /* index of the first block */
+    size_t length; /* in bytes */
+    uchar previous[BLOCK_LENGTH]; /* for CBC, the block before in : IV or
+				     the last cipher block of the chunk before */
+} chunk_t;
+
+
+/* Calls work on length bytes of in and out cut into chunks. Inputs of
+   less than MODES_MIN_THREAD_BLOCKS blocks per thread are not worth a
+   thread; otherwise the calling thread takes the last chunk. The block
+   before each chunk is copied first, since out may be equal to in. */
+static void run_chunks(void *(*work)(void *), aes_ctx_t *ctx, uchar *IV,
+		       uchar *out, uchar *in, size_t length){
+    size_t nr_blocks = (length + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+    size_t nr_threads = parallel_nr_threads();
+    if(nr_threads > nr_blocks / MODES_MIN_THREAD_BLOCKS)
+	nr_threads = nr_blocks / MODES_MIN_THREAD_BLOCKS;
+    if(nr_threads <= 1){
+	chunk_t all = {ctx, IV, out, in, 0, length};
+	memcpy(all.previous, IV, BLOCK_LENGTH);
+	work(&all);
+	return;
+    }
+
+    // 1. One chunk per thread
+    chunk_t chunk[PARALLEL_MAX_THREADS];
+    size_t t, per_thread = (nr_blocks + nr_threads - 1) / nr_threads;
+    for(t = 0; t < nr_threads; t++){
+	size_t first = t * per_thread;
+	size_t last = first + per_thread < nr_blocks ? first + per_thread : nr_blocks;
+	chunk[t].ctx = ctx;
+	chunk[t].IV = IV;
+	chunk[t].out = out + first * BLOCK_LENGTH;
+	chunk[t].in = in + first * BLOCK_LENGTH;
+	chunk[t].first = first;
+	chunk[t].length = (last == nr_blocks ? length : last * BLOCK_LENGTH)
+	    - first * BLOCK_LENGTH;
+	memcpy(chunk[t].previous, first == 0 ? IV : chunk[t].in - BLOCK_LENGTH,
+	       BLOCK_LENGTH);
+    }
+
+    // 2. Run them
+    parallel_run(work, chunk, sizeof(chunk_t), (int)nr_threads);
+}
+
+
+/* out = a xor b on one block, 8 bytes at a time; longer runs go through
+   xorBytes() */
+static void xor_block(uchar *out, uchar *a, uchar *b){
+    uint64_t x, y;
     size_t i;
-    for(i = 0; i < l; i++, cursor++)
-	buffer_append_uchar(out, *cursor);
+    for(i = 0; i < BLOCK_LENGTH; i += 8){
+	memcpy(&x, a + i, 8);
+	memcpy(&y, b + i, 8);
+	x ^= y;
+	memcpy(out + i, &x, 8);
+    }
 }
 
+
 // CBC Mode, the input should have length which is a multiple of 16
 int aes_raw_CBC_encrypt(buffer_t *encrypted, buffer_t *in, buffer_t *key, buffer_t *IV){
+    aes_ctx_t ctx;
+    if(!aes_ctx_init(&ctx, key)){
+	buffer_reset(encrypted);
+	return 0;
+    }
+    int r = aes_raw_CBC_encrypt_ctx(encrypted, in, &ctx, IV);
+    aes_ctx_clear(&ctx);
+    return r;
+}
+
+
+// Same, with a key schedule computed once by aes_ctx_init
+int aes_raw_CBC_encrypt_ctx(buffer_t *encrypted, buffer_t *in, aes_ctx_t *ctx,
+			    buffer_t *IV){
     buffer_reset(encrypted);
     if(in->length % BLOCK_LENGTH != 0){
 	perror("[aes_raw_CBC_encrypt]: The input has not been padded.\n");
 	return 0;
     }
-    // 1. Initialisation
-    buffer_t to_Xor;
-    buffer_t tmp_in;
-    buffer_t tmp_out;
-    buffer_init(&to_Xor, BLOCK_LENGTH);
-    buffer_init(&tmp_in, BLOCK_LENGTH);
-    buffer_init(&tmp_out, BLOCK_LENGTH);
-
-    // 2. Initialise to_Xor with IV and put IV on the begginning of encrypted
-    buffer_append(&to_Xor, IV);
-    buffer_append(encrypted, IV);
-
-    // 3. Main Loop
-    uchar *cursor = in->tab;	
-    int i, j;
-    for(i = 0; i < in->length / BLOCK_LENGTH; i++){
-#if DEBUG
-	printf("[aes_raw_CBC_encrypt] Treating block number %d.\t Length of encrypted = %d.\n",
-	       i, (int)encrypted->length);	
-#endif
-	// 3.1. Copy plain_text in tmp_in
-	for(j = 0; j < BLOCK_LENGTH; j++, cursor++)
-	    buffer_append_uchar(&tmp_in, *cursor);
+    // encrypted = IV || in, then encrypted in place after IV
+    if(buffer_resize(encrypted, BLOCK_LENGTH + in->length) == 0)
+	return 0;
+    memcpy(encrypted->tab, IV->tab, BLOCK_LENGTH);
+    memcpy(encrypted->tab + BLOCK_LENGTH, in->tab, in->length);
+    encrypted->length = BLOCK_LENGTH + in->length;
+    return aes_cbc_encrypt_inplace(ctx, IV->tab, encrypted->tab + BLOCK_LENGTH,
+				   in->length);
+}
+
 
-	// 3.2. Xor tmp_in with to_Xor
-	oneTimePad(&tmp_out, &tmp_in, &to_Xor);
+int aes_raw_CBC_decrypt(buffer_t *decrypted, buffer_t *in, buffer_t *key){
+    aes_ctx_t ctx;
+    if(!aes_ctx_init(&ctx, key)){
+	buffer_reset(decrypted);
+	return 0;
+    }
+    int r = aes_raw_CBC_decrypt_ctx(decrypted, in, &ctx);
+    aes_ctx_clear(&ctx);
+    return r;
+}
 
-	// 3.3. Encrypt
-	aes_block_encrypt(&to_Xor, &tmp_out, key);
 
-	// 3.4. Prepare next loop
-	buffer_reset(&tmp_in);
-	buffer_append(encrypted, &to_Xor);
+/* P_i = D(C_i) xor C_{i-1} : MODES_BATCH blocks are decrypted at once,
+   then xored in one pass. The cipher blocks of the batch are kept aside
+   since out may be equal to in. */
+static void *CBC_decrypt_chunk(void *arg){
+    chunk_t *chunk = (chunk_t *)arg;
+    uchar saved[MODES_BATCH * BLOCK_LENGTH], previous[BLOCK_LENGTH];
+    size_t done, k;
+    memcpy(previous, chunk->previous, BLOCK_LENGTH);
+    for(done = 0; done < chunk->length; done += k){
+	k = chunk->length - done;
+	if(k > MODES_BATCH * BLOCK_LENGTH)
+	    k = MODES_BATCH * BLOCK_LENGTH;
+	memcpy(saved, chunk->in + done, k);
+	aes_decrypt_blocks(chunk->ctx, chunk->out + done, saved, k / BLOCK_LENGTH);
+	xor_block(chunk->out + done, chunk->out + done, previous);
+	xorBytes(chunk->out + done + BLOCK_LENGTH, chunk->out + done + BLOCK_LENGTH,
+		 saved, k - BLOCK_LENGTH);
+	memcpy(previous, saved + k - BLOCK_LENGTH, BLOCK_LENGTH);
     }
+    memset(saved, 0, sizeof(saved));
+    return NULL;
+}
 
-    // 4. Free Memory
-    buffer_clear(&tmp_in);
-    buffer_clear(&tmp_out);
-    buffer_clear(&to_Xor);
+
+/* Same as aes_raw_CBC_encrypt/decrypt on memory owned by the caller,
+   without allocation : data[0..length[, length being a multiple of
+   BLOCK_LENGTH, is replaced by its encryption (resp. decryption).
+   IV is not part of data. */
+int aes_cbc_encrypt_inplace(aes_ctx_t *ctx, uchar IV[], uint8_t *data,
+			    size_t length){
+    if(length % BLOCK_LENGTH != 0){
+	perror("[aes_cbc_encrypt_inplace]: The input has not been padded.\n");
+	return 0;
+    }
+    uchar *previous = IV;
+    size_t i;
+    for(i = 0; i < length; i += BLOCK_LENGTH){
+	xor_block(data + i, data + i, previous);
+	aes_ctx_encrypt(ctx, data + i, data + i);
+	previous = data + i;
+    }
     return 1;
 }
 
 
-int aes_raw_CBC_decrypt(buffer_t *decrypted, buffer_t *in, buffer_t *key){
+int aes_cbc_decrypt_inplace(aes_ctx_t *ctx, uchar IV[], uint8_t *data,
+			    size_t length){
+    if(length % BLOCK_LENGTH != 0){
+	perror("[aes_cbc_decrypt_inplace]: The input is not a valid cipher text.\n");
+	return 0;
+    }
+    run_chunks(CBC_decrypt_chunk, ctx, IV, data, data, length);
+    return 1;
+}
+
+
+int aes_raw_CBC_decrypt_ctx(buffer_t *decrypted, buffer_t *in, aes_ctx_t *ctx){
     buffer_reset(decrypted);
     if(in->length % BLOCK_LENGTH != 0){
 #if DEBUG == 0
@@ -146,53 +263,54 @@ int aes_raw_CBC_decrypt(buffer_t *decrypted, buffer_t *in, buffer_t *key){
 #endif
 	return 0;
     }
-    // 1. Initialisation
-    buffer_t to_Xor;
-    buffer_t tmp_in;
-    buffer_t tmp_dec;
-    buffer_t tmp_out;
-    buffer_init(&to_Xor, BLOCK_LENGTH);
-    buffer_init(&tmp_in, BLOCK_LENGTH);
-    buffer_init(&tmp_dec, BLOCK_LENGTH);
-    buffer_init(&tmp_out, BLOCK_LENGTH);
-
-    // 2. Initialise the to_Xor with IV
-    uchar *cursor = in->tab;
-    int i, j;
-    for(i = 0; i < BLOCK_LENGTH; i++, cursor++)
-	buffer_append_uchar(&to_Xor, *cursor);
-	
-    // 3. Main loop
-    for(i = 1; i < in->length / BLOCK_LENGTH; i++){
-#if DEBUG
-	printf("[aes_raw_CBC_decrypt] Treating block number %d.\t Length of decrypted = %d.\n",
-	       i, (int)decrypted->length);	
-#endif
-	// 3.1 Copy encrypted in tmp_in
-	for(j = 0; j < BLOCK_LENGTH; j++, cursor++)
-	    buffer_append_uchar(&tmp_in, *cursor);
+    // The first block is IV
+    if(in->length < 2 * BLOCK_LENGTH)
+	return 1;
+    size_t length = in->length - BLOCK_LENGTH;
+    if(buffer_resize(decrypted, length) == 0)
+	return 0;
+    memcpy(decrypted->tab, in->tab + BLOCK_LENGTH, length);
+    decrypted->length = length;
+    return aes_cbc_decrypt_inplace(ctx, in->tab, decrypted->tab, length);
+}
 
-	// 3.2. Decrypt
-	aes_block_decrypt(&tmp_dec, &tmp_in, key);
 
-	// 3.3. Xor
-	oneTimePad(&tmp_out, &tmp_dec, &to_Xor);
+/* Padding of the last block, np bytes of which are in last */
+static void CBC_pad_block(uchar last[], size_t np, char mode){
+    size_t i;
+    if(mode == 's'){
+	last[np] = 1 << (BYTE_SIZE - 1);
+	for(i = np + 1; i < BLOCK_LENGTH; i++)
+	    last[i] = 0;
+    }
+    else
+	for(i = np; i < BLOCK_LENGTH; i++)
+	    last[i] = (uchar)(BLOCK_LENGTH - np);
+}
 
-	// 3.4 Finish the loop
-	buffer_clone(&to_Xor, &tmp_in);
-	buffer_append(decrypted, &tmp_out);
-	buffer_reset(&tmp_in);
-    }	
 
-    // 4. Free Memory
-    buffer_clear(&tmp_in);
-    buffer_clear(&tmp_dec);
-    buffer_clear(&tmp_out);
-    buffer_clear(&to_Xor);
-    return 1;
+/* Number of message bytes in the last block, -1 if its padding is not
+   valid */
+static int CBC_unpad_block(uchar last[], char mode){
+    int l, i;
+    if(mode == 's'){
+	for(l = BLOCK_LENGTH; l > 0 && last[l - 1] == 0; l--);
+	if(l == 0 || last[l - 1] != 1 << (BYTE_SIZE - 1))
+	    return -1;
+	return l - 1;
+    }
+    uchar a = last[BLOCK_LENGTH - 1];
+    if(a == 0 || a > BLOCK_LENGTH)
+	return -1;
+    for(i = 1; i < a; i++)
+	if(last[BLOCK_LENGTH - 1 - i] != a)
+	    return -1;
+    return BLOCK_LENGTH - a;
 }
 
 
+/* IV || IV || C || SHA3(IV || IV || C) : the plain text is copied,
+   encrypted and hashed one segment at a time, while it is in cache */
 int aes_CBC_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
 		    buffer_t *IV, char mode){
     if(key->length != BLOCK_LENGTH || IV->length != BLOCK_LENGTH){
@@ -210,41 +328,69 @@ int aes_CBC_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
 #endif
 	return 0;
     }
+    if(mode != 's' && mode != 'R'){
+	perror("[aes_CBC_encrypt] ERROR: mode should be either 's' or 'R'.\n");
+	return 0;
+    }
 
     // 1. Initialisation
-    buffer_reset(encrypted);
-    buffer_t padded, raw, hash;
-    buffer_init(&padded, BLOCK_LENGTH);
-    buffer_init(&raw, BLOCK_LENGTH);
-    buffer_init(&hash, HASH_LENGTH);
+    aes_ctx_t ctx;
+    sha3_ctx_t hash;
+    uchar last[BLOCK_LENGTH];
+    size_t np = plain->length % BLOCK_LENGTH, full = plain->length - np;
+    size_t length = full + BLOCK_LENGTH, done, n;
+    encrypted->length = 0;
+    if(!aes_ctx_init(&ctx, key))
+	return 0;
+    if(buffer_resize(encrypted, 2 * BLOCK_LENGTH + length + HASH_LENGTH) == 0){
+	aes_ctx_clear(&ctx);
+	return 0;
+    }
+    uchar *out = encrypted->tab + 2 * BLOCK_LENGTH;
 
     // 2. Start
-    buffer_append(encrypted, IV);
-
-    // 3. Padding and encryption
-    pad(&padded, plain, mode);
-    aes_raw_CBC_encrypt(&raw, &padded, key, IV);
-    buffer_append(encrypted, &raw);
-
-    // 4. Mac
-    buffer_hash(&hash, HASH_LENGTH, encrypted);
-    buffer_append(encrypted, &hash);
+    memcpy(encrypted->tab, IV->tab, BLOCK_LENGTH);
+    memcpy(encrypted->tab + BLOCK_LENGTH, IV->tab, BLOCK_LENGTH);
+    sha3_init(&hash, HASH_LENGTH);
+    sha3_update(&hash, encrypted->tab, 2 * BLOCK_LENGTH);
+    memcpy(last, plain->tab + full, np);
+    CBC_pad_block(last, np, mode);
+
+    // 3. Padding, encryption and Mac, segment by segment
+    for(done = 0; done < length; done += n){
+	n = length - done;
+	if(n > MODES_SEGMENT_BLOCKS * BLOCK_LENGTH)
+	    n = MODES_SEGMENT_BLOCKS * BLOCK_LENGTH;
+	if(done + n < length)
+	    memcpy(out + done, plain->tab + done, n);
+	else{
+	    memcpy(out + done, plain->tab + done, n - BLOCK_LENGTH);
+	    memcpy(out + length - BLOCK_LENGTH, last, BLOCK_LENGTH);
+	}
+	aes_cbc_encrypt_inplace(&ctx, out + done - BLOCK_LENGTH, out + done, n);
+	sha3_update(&hash, out + done, n);
+    }
+    sha3_final(out + length, &hash);
+    encrypted->length = 2 * BLOCK_LENGTH + length + HASH_LENGTH;
 	
     // . Free Memory
-    buffer_clear(&padded);
-    buffer_clear(&raw);
-    buffer_clear(&hash);
+    memset(last, 0, BLOCK_LENGTH);
+    aes_ctx_clear(&ctx);
     return 1;
 }
 
 
+/* The cipher text is read in place : each segment is hashed, then
+   decrypted on several threads while it is still in cache. The plain
+   text is wiped if the tag does not match. */
 int aes_CBC_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key,
 		     char mode){
     if(key->length != BLOCK_LENGTH){
 	perror("[aes_CBC_decrypt] ERROR: Key does not have the good length.\n");
 	return 0;
     }
-    if(encrypted->length % BLOCK_LENGTH != 0){
+    if(encrypted->length % BLOCK_LENGTH != 0
+       || encrypted->length < 3 * BLOCK_LENGTH + HASH_LENGTH){
 #if DEBUG == 0
 	perror("[aes_CBC_decrypt] ERROR: Input is not a valid ciphertext.\n");
 #else
@@ -255,49 +401,618 @@ int aes_CBC_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key,
 #endif
 	return 0;
     }
+    if(mode != 's' && mode != 'R'){
+	perror("[aes_CBC_decrypt] ERROR: mode should be either 's' or 'R'.\n");
+	return 0;
+    }
 
     // 1. Initialisation
-    buffer_t IV, IV_cat_raw, raw, padded, hash, hash_test;
-    buffer_init(&IV, BLOCK_LENGTH);
-    buffer_init(&IV_cat_raw, BLOCK_LENGTH);
-    buffer_init(&raw, BLOCK_LENGTH);
-    buffer_init(&padded, BLOCK_LENGTH);
-    buffer_init(&hash, HASH_LENGTH);
-    buffer_init(&hash_test, HASH_LENGTH);
+    aes_ctx_t ctx;
+    sha3_ctx_t hash;
+    uchar tag[HASH_LENGTH], diff = 0;
+    uchar *in = encrypted->tab + 2 * BLOCK_LENGTH;
+    size_t length = encrypted->length - 2 * BLOCK_LENGTH - HASH_LENGTH, done, n, i;
+    size_t segment = (size_t)parallel_nr_threads() * MODES_SEGMENT_BLOCKS * BLOCK_LENGTH;
+    decrypted->length = 0;
+    if(!aes_ctx_init(&ctx, key))
+	return 0;
+    if(buffer_resize(decrypted, length) == 0){
+	aes_ctx_clear(&ctx);
+	return 0;
+    }
+    sha3_init(&hash, HASH_LENGTH);
+    sha3_update(&hash, encrypted->tab, 2 * BLOCK_LENGTH);
+
+    // 2. Mac and decryption, segment by segment
+    for(done = 0; done < length; done += n){
+	n = length - done < segment ? length - done : segment;
+	sha3_update(&hash, in + done, n);
+	run_chunks(CBC_decrypt_chunk, &ctx, in + done - BLOCK_LENGTH,
+		   decrypted->tab + done, in + done, n);
+    }
+    aes_ctx_clear(&ctx);
+
+    // 3. Verification of integrity
+    sha3_final(tag, &hash);
+    for(i = 0; i < HASH_LENGTH; i++)
+	diff |= tag[i] ^ in[length + i];
+    if(diff != 0){
+	perror("[aes_CBC_decrypt] ERROR: hash values differ.\n");
+	memset(decrypted->tab, 0, length);
+	return 0;
+    }
 
-    // 2. Fill in buffers
-    int i = 0;
-    uchar *cursor = encrypted->tab;
-    for(; i < BLOCK_LENGTH; i++, cursor++){
-	buffer_append_uchar(&IV, *cursor);
-	buffer_append_uchar(&IV_cat_raw, *cursor);
+    // 4. Padding
+    int l = CBC_unpad_block(decrypted->tab + length - BLOCK_LENGTH, mode);
+    if(l < 0){
+	perror("[aes_CBC_decrypt] ERROR: the padding is not valid.\n");
+	memset(decrypted->tab, 0, length);
+	return 0;
     }
+    decrypted->length = length - BLOCK_LENGTH + l;
+    return 1;
+}
+
 
-    for(; i < encrypted->length - HASH_LENGTH; i++, cursor++){
-	buffer_append_uchar(&raw, *cursor);
-	buffer_append_uchar(&IV_cat_raw, *cursor);
+/**********************************************************/
+/* CTR mode : block i of the keystream is AES(IV + i),    */
+/* IV being read as a 128-bit big endian integer. Blocks  */
+/* do not depend on each other, hence long messages are   */
+/* cut into chunks handled by several threads.            */
+/**********************************************************/
+
+/* counter = IV + i */
+static void CTR_counter(uchar counter[], uchar IV[], size_t i){
+    int j;
+    unsigned int carry = 0;
+    for(j = BLOCK_LENGTH - 1; j >= 0; j--){
+	carry += IV[j] + (uchar)i;
+	counter[j] = (uchar)carry;
+	carry >>= BYTE_SIZE;
+	i >>= BYTE_SIZE;
     }
+}
 
-    for(; i < encrypted->length; i++, cursor++)
-	buffer_append_uchar(&hash, *cursor);
 
-    // 3. Verification of integrity
-    buffer_hash(&hash_test, HASH_LENGTH, &IV_cat_raw);
-    if(!buffer_equality(&hash_test, &hash)){
-	perror("[aes_CBC_decrypt] ERROR: hash values differ.\n");
+static void CTR_increment(uchar counter[]){
+    int j = BLOCK_LENGTH - 1;
+    while(j >= 0 && ++counter[j] == 0)
+	j--;
+}
+
+
+/* out = in xor keystream, MODES_BATCH blocks at a time */
+static void *CTR_xor_chunk(void *arg){
+    chunk_t *chunk = (chunk_t *)arg;
+    uchar stream[MODES_BATCH * BLOCK_LENGTH], counter[BLOCK_LENGTH];
+    size_t done = 0, i, k, nr_blocks;
+    CTR_counter(counter, chunk->IV, chunk->first);
+    while(done < chunk->length){
+	k = chunk->length - done;
+	if(k > MODES_BATCH * BLOCK_LENGTH)
+	    k = MODES_BATCH * BLOCK_LENGTH;
+	nr_blocks = (k + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+	for(i = 0; i < nr_blocks; i++){
+	    memcpy(stream + i * BLOCK_LENGTH, counter, BLOCK_LENGTH);
+	    CTR_increment(counter);
+	}
+	aes_encrypt_blocks(chunk->ctx, stream, stream, nr_blocks);
+	xorBytes(chunk->out + done, chunk->in + done, stream, k);
+	done += k;
+    }
+    memset(stream, 0, sizeof(stream));
+    memset(counter, 0, sizeof(counter));
+    return NULL;
+}
+
+
+/* Encryption and decryption are the same. out may be equal to in. */
+int aes_raw_CTR_ctx(buffer_t *out, buffer_t *in, aes_ctx_t *ctx,
+		    buffer_t *IV){
+    if(IV->length != BLOCK_LENGTH){
+	perror("[aes_raw_CTR] ERROR: IV does not have the good length.\n");
 	return 0;
     }
+    size_t length = in->length;
+    if(buffer_resize(out, length) == 0)
+	return 0;
+    run_chunks(CTR_xor_chunk, ctx, IV->tab, out->tab, in->tab, length);
+    out->length = length;
+    return 1;
+}
 
-    // 4. Decrypt
-    aes_raw_CBC_decrypt(&padded, &raw, key);
-    extract(decrypted, &padded, mode);		
-	
-    // 5. Free memory
-    buffer_clear(&IV);
-    buffer_clear(&raw);
-    buffer_clear(&IV_cat_raw);
-    buffer_clear(&padded);
-    buffer_clear(&hash);
-    buffer_clear(&hash_test);
+
+/* encrypted = IV || raw CTR encryption of plain || SHA3 hash of the former,
+   as for CBC. No padding is needed. */
+int aes_CTR_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
+		    buffer_t *IV){
+    if(IV->length != BLOCK_LENGTH){
+	perror("[aes_CTR_encrypt] ERROR: IV does not have the good length.\n");
+	return 0;
+    }
+    aes_ctx_t ctx;
+    if(!aes_ctx_init(&ctx, key))
+	return 0;
+
+    // 1. Room for the whole output
+    size_t length = plain->length;
+    if(buffer_set_length(encrypted, BLOCK_LENGTH + length + HASH_LENGTH) == 0){
+	aes_ctx_clear(&ctx);
+	return 0;
+    }
+
+    // 2. IV and encryption, written in place
+    uchar *raw = encrypted->tab + BLOCK_LENGTH;
+    memcpy(encrypted->tab, IV->tab, BLOCK_LENGTH);
+    run_chunks(CTR_xor_chunk, &ctx, IV->tab, raw, plain->tab, length);
+
+    // 3. Mac
+    sha3_ctx_t sha;
+    sha3_init(&sha, HASH_LENGTH);
+    sha3_update(&sha, encrypted->tab, BLOCK_LENGTH + length);
+    sha3_final(raw + length, &sha);
+
+    // 4. Free Memory
+    aes_ctx_clear(&ctx);
     return 1;
 }
+
+
+/* decrypted may be equal to encrypted */
+int aes_CTR_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key){
+    if(encrypted->length < BLOCK_LENGTH + HASH_LENGTH){
+	perror("[aes_CTR_decrypt] ERROR: Input is not a valid ciphertext.\n");
+	return 0;
+    }
+    aes_ctx_t ctx;
+    if(!aes_ctx_init(&ctx, key))
+	return 0;
+
+    // 1. Verification of integrity : hash of IV || raw, read in place
+    size_t raw_length = encrypted->length - BLOCK_LENGTH - HASH_LENGTH;
+    uchar *IV = encrypted->tab, *raw = encrypted->tab + BLOCK_LENGTH;
+    uchar *tag = raw + raw_length, hash_test[HASH_LENGTH], diff = 0;
+    sha3_ctx_t sha;
+    int i;
+    sha3_init(&sha, HASH_LENGTH);
+    sha3_update(&sha, encrypted->tab, BLOCK_LENGTH + raw_length);
+    sha3_final(hash_test, &sha);
+
+    // Constant time comparison
+    for(i = 0; i < HASH_LENGTH; i++)
+	diff |= hash_test[i] ^ tag[i];
+    if(diff != 0){
+	perror("[aes_CTR_decrypt] ERROR: hash values differ.\n");
+	aes_ctx_clear(&ctx);
+	return 0;
+    }
+
+    // 2. Decryption straight from the cipher text
+    if(decrypted == encrypted){
+	run_chunks(CTR_xor_chunk, &ctx, IV, raw, raw, raw_length);
+	memmove(encrypted->tab, raw, raw_length);
+    }
+    else{
+	if(buffer_resize(decrypted, raw_length) == 0){
+	    aes_ctx_clear(&ctx);
+	    return 0;
+	}
+	run_chunks(CTR_xor_chunk, &ctx, IV, decrypted->tab, raw, raw_length);
+    }
+    decrypted->length = raw_length;
+
+    aes_ctx_clear(&ctx);
+    return 1;
+}
+
+
+/**********************************************************/
+/* GCM mode (NIST SP 800-38D) : CTR encryption from the   */
+/* counter J0 + 1 (only the last 32 bits are counting),   */
+/* authenticated by GHASH over the associated data and    */
+/* the cipher text. Each batch of keystream is used and   */
+/* hashed while it is in cache : one pass over the data.  */
+/**********************************************************/
+
+int aes_GCM_ctx_init(aes_gcm_ctx_t *ctx, buffer_t *key){
+    uchar zero[BLOCK_LENGTH], H[BLOCK_LENGTH];
+    if(!aes_ctx_init(&ctx->aes, key))
+	return 0;
+    memset(zero, 0, BLOCK_LENGTH);
+    aes_ctx_encrypt(&ctx->aes, H, zero);
+    ghash_init(&ctx->ghash, H);
+    memset(H, 0, BLOCK_LENGTH);
+    return 1;
+}
+
+
+void aes_GCM_ctx_clear(aes_gcm_ctx_t *ctx){
+    aes_ctx_clear(&ctx->aes);
+    ghash_clear(&ctx->ghash);
+}
+
+
+/* Two 64-bit big endian lengths in bits */
+static void GCM_lengths(uchar lengths[], size_t length1, size_t length2){
+    int j;
+    uint64_t bits1 = (uint64_t)length1 * BYTE_SIZE;
+    uint64_t bits2 = (uint64_t)length2 * BYTE_SIZE;
+    for(j = 7; j >= 0; j--, bits1 >>= 8, bits2 >>= 8){
+	lengths[j] = (uchar)bits1;
+	lengths[8 + j] = (uchar)bits2;
+    }
+}
+
+
+/* J0 = IV || 0^31 || 1 for the usual 96-bit IV, else GHASH(IV, length) */
+static void GCM_J0(aes_gcm_ctx_t *ctx, uchar J0[], buffer_view_t IV){
+    uchar lengths[BLOCK_LENGTH];
+    memset(J0, 0, BLOCK_LENGTH);
+    if(IV.length == GCM_IV_LENGTH){
+	memcpy(J0, IV.tab, GCM_IV_LENGTH);
+	J0[BLOCK_LENGTH - 1] = 1;
+	return;
+    }
+    ghash_update(&ctx->ghash, J0, IV.tab, IV.length);
+    GCM_lengths(lengths, 0, IV.length);
+    ghash_update(&ctx->ghash, J0, lengths, BLOCK_LENGTH);
+}
+
+
+static void GCM_inc32(uchar counter[]){
+    int j = BLOCK_LENGTH - 1;
+    while(j >= BLOCK_LENGTH - 4 && ++counter[j] == 0)
+	j--;
+}
+
+
+/* out = in xor keystream from counter; Y is fed with the cipher text,
+   which is in when decrypting, out otherwise. out may be equal to in. */
+static void GCM_crypt(aes_gcm_ctx_t *ctx, uchar Y[], uchar counter[],
+		      uchar *out, uchar *in, size_t length, int decrypt){
+    uchar stream[MODES_BATCH * BLOCK_LENGTH];
+    size_t i, k, nr_blocks;
+    while(length > 0){
+	k = length < MODES_BATCH * BLOCK_LENGTH ? length : MODES_BATCH * BLOCK_LENGTH;
+	nr_blocks = (k + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+	for(i = 0; i < nr_blocks; i++){
+	    memcpy(stream + i * BLOCK_LENGTH, counter, BLOCK_LENGTH);
+	    GCM_inc32(counter);
+	}
+	aes_encrypt_blocks(&ctx->aes, stream, stream, nr_blocks);
+	if(decrypt)
+	    ghash_update(&ctx->ghash, Y, in, k);
+	xorBytes(out, in, stream, k);
+	if(!decrypt)
+	    ghash_update(&ctx->ghash, Y, out, k);
+	in += k;
+	out += k;
+	length -= k;
+    }
+    memset(stream, 0, sizeof(stream));
+}
+
+
+/* tag = AES(J0) xor GHASH(aad, cipher text, lengths) */
+static void GCM_crypt_and_tag(aes_gcm_ctx_t *ctx, uchar tag[], uchar *out,
+			      uchar *in, size_t length, buffer_view_t aad,
+			      buffer_view_t IV, int decrypt){
+    uchar J0[BLOCK_LENGTH], counter[BLOCK_LENGTH], Y[BLOCK_LENGTH];
+    uchar lengths[BLOCK_LENGTH];
+    int i;
+
+    GCM_J0(ctx, J0, IV);
+    memcpy(counter, J0, BLOCK_LENGTH);
+    GCM_inc32(counter);
+    memset(Y, 0, BLOCK_LENGTH);
+    if(aad.length > 0)
+	ghash_update(&ctx->ghash, Y, aad.tab, aad.length);
+    GCM_crypt(ctx, Y, counter, out, in, length, decrypt);
+    GCM_lengths(lengths, aad.length, length);
+    ghash_update(&ctx->ghash, Y, lengths, BLOCK_LENGTH);
+    aes_ctx_encrypt(&ctx->aes, tag, J0);
+    for(i = 0; i < BLOCK_LENGTH; i++)
+	tag[i] ^= Y[i];
+    memset(counter, 0, BLOCK_LENGTH);
+}
+
+
+/* The associated data, if any */
+static buffer_view_t GCM_aad(buffer_t *aad){
+    buffer_view_t none = {NULL, 0};
+    return aad == NULL ? none : buffer_view(aad, 0, aad->length);
+}
+
+
+/* decrypted = in[0..length[ decrypted if tag is the good one; otherwise
+   0 is returned and nothing is released */
+static int GCM_open(aes_gcm_ctx_t *ctx, buffer_t *decrypted, uchar *in,
+		    size_t length, uchar *tag, buffer_view_t aad,
+		    buffer_view_t IV){
+    uchar tag_test[BLOCK_LENGTH], diff = 0;
+    int i;
+    if(buffer_resize(decrypted, length) == 0)
+	return 0;
+    GCM_crypt_and_tag(ctx, tag_test, decrypted->tab, in, length, aad, IV, 1);
+    decrypted->length = length;
+
+    // Constant time comparison
+    for(i = 0; i < GCM_TAG_LENGTH; i++)
+	diff |= tag_test[i] ^ tag[i];
+    if(diff != 0){
+	buffer_wipe(decrypted);
+	return 0;
+    }
+    return 1;
+}
+
+
+/* aad (associated data) may be NULL. tag gets GCM_TAG_LENGTH bytes. */
+int aes_raw_GCM_encrypt_ctx(buffer_t *encrypted, buffer_t *tag, buffer_t *in,
+			    buffer_t *aad, aes_gcm_ctx_t *ctx, buffer_t *IV){
+    if(IV->length == 0){
+	perror("[aes_raw_GCM_encrypt] ERROR: IV should not be empty.\n");
+	return 0;
+    }
+    if(buffer_resize(encrypted, in->length) == 0
+       || buffer_resize(tag, GCM_TAG_LENGTH) == 0)
+	return 0;
+    GCM_crypt_and_tag(ctx, tag->tab, encrypted->tab, in->tab, in->length,
+		      GCM_aad(aad), buffer_view(IV, 0, IV->length), 0);
+    encrypted->length = in->length;
+    tag->length = GCM_TAG_LENGTH;
+    return 1;
+}
+
+
+/* Returns 0 and an empty decrypted if the tag is not the good one. */
+int aes_raw_GCM_decrypt_ctx(buffer_t *decrypted, buffer_t *in, buffer_t *tag,
+			    buffer_t *aad, aes_gcm_ctx_t *ctx, buffer_t *IV){
+    if(IV->length == 0 || tag->length != GCM_TAG_LENGTH){
+	perror("[aes_raw_GCM_decrypt] ERROR: IV or tag do not have the good length.\n");
+	return 0;
+    }
+    return GCM_open(ctx, decrypted, in->tab, in->length, tag->tab, GCM_aad(aad),
+		    buffer_view(IV, 0, IV->length));
+}
+
+
+/* encrypted = IV || C || tag, IV having GCM_IV_LENGTH bytes */
+int aes_GCM_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
+		    buffer_t *IV){
+    if(IV->length != GCM_IV_LENGTH){
+	perror("[aes_GCM_encrypt] ERROR: IV does not have the good length.\n");
+	return 0;
+    }
+    aes_gcm_ctx_t ctx;
+    if(!aes_GCM_ctx_init(&ctx, key))
+	return 0;
+    size_t length = plain->length;
+    if(buffer_resize(encrypted, GCM_IV_LENGTH + length + GCM_TAG_LENGTH) == 0){
+	aes_GCM_ctx_clear(&ctx);
+	return 0;
+    }
+    memcpy(encrypted->tab, IV->tab, GCM_IV_LENGTH);
+    GCM_crypt_and_tag(&ctx, encrypted->tab + GCM_IV_LENGTH + length,
+		      encrypted->tab + GCM_IV_LENGTH, plain->tab, length,
+		      GCM_aad(NULL), buffer_view(IV, 0, GCM_IV_LENGTH), 0);
+    encrypted->length = GCM_IV_LENGTH + length + GCM_TAG_LENGTH;
+    aes_GCM_ctx_clear(&ctx);
+    return 1;
+}
+
+
+int aes_GCM_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key){
+    if(encrypted->length < GCM_IV_LENGTH + GCM_TAG_LENGTH){
+	perror("[aes_GCM_decrypt] ERROR: Input is not a valid ciphertext.\n");
+	return 0;
+    }
+    aes_gcm_ctx_t ctx;
+    if(!aes_GCM_ctx_init(&ctx, key))
+	return 0;
+
+    // 1. Views on IV, C and tag inside encrypted
+    size_t length = encrypted->length - GCM_IV_LENGTH - GCM_TAG_LENGTH;
+    buffer_view_t IV = buffer_view(encrypted, 0, GCM_IV_LENGTH);
+    buffer_view_t raw = buffer_view(encrypted, GCM_IV_LENGTH, length);
+    buffer_view_t tag = buffer_view(encrypted, GCM_IV_LENGTH + length,
+				    GCM_TAG_LENGTH);
+
+    // 2. Decrypt and check
+    int ok = GCM_open(&ctx, decrypted, raw.tab, raw.length, tag.tab,
+		      GCM_aad(NULL), IV);
+    if(!ok)
+	perror("[aes_GCM_decrypt] ERROR: authentication failed.\n");
+    aes_GCM_ctx_clear(&ctx);
+    return ok;
+}
+
+
+/**********************************************************/
+/* Streaming CBC : the same output as aes_CBC_encrypt,    */
+/* IV || IV || C || SHA3(IV || IV || C), produced chunk   */
+/* by chunk. Only the blocks not complete yet are kept,   */
+/* and the tag absorbs the cipher text as it goes, hence  */
+/* the memory used does not depend on the input length.   */
+/**********************************************************/
+
+/* Treats length bytes of full blocks, returns the number of bytes
+   written in out. Decryption skips the two IV blocks. */
+static size_t CBC_stream_blocks(aes_cbc_stream_t *st, uchar *out, uchar *in,
+				size_t length){
+    if(!st->decrypt){
+	memcpy(out, in, length);
+	aes_cbc_encrypt_inplace(&st->aes, st->previous, out, length);
+	memcpy(st->previous, out + length - BLOCK_LENGTH, BLOCK_LENGTH);
+	sha3_update(&st->hash, out, length);
+	return length;
+    }
+    for(; length > 0 && st->nr_blocks < 2; st->nr_blocks++){
+	sha3_update(&st->hash, in, BLOCK_LENGTH);
+	memcpy(st->previous, in, BLOCK_LENGTH);
+	in += BLOCK_LENGTH;
+	length -= BLOCK_LENGTH;
+    }
+    if(length == 0)
+	return 0;
+    sha3_update(&st->hash, in, length);
+    memcpy(out, in, length);
+    aes_cbc_decrypt_inplace(&st->aes, st->previous, out, length);
+    memcpy(st->previous, in + length - BLOCK_LENGTH, BLOCK_LENGTH);
+    st->nr_blocks += length / BLOCK_LENGTH;
+    return length;
+}
+
+
+/* out = the full blocks of pending || in, except the last keep bytes
+   which stay pending. */
+static int CBC_stream_feed(aes_cbc_stream_t *st, buffer_t *out, uchar *in,
+			   size_t length, size_t keep){
+    size_t total = st->nr_pending + length, n, head, r;
+    out->length = 0;
+    if(total < keep + BLOCK_LENGTH){
+	memcpy(st->pending + st->nr_pending, in, length);
+	st->nr_pending = total;
+	return 1;
+    }
+    n = (total - keep) / BLOCK_LENGTH * BLOCK_LENGTH;
+    if(buffer_resize(out, n) == 0)
+	return 0;
+    if(n <= st->nr_pending){
+	out->length = CBC_stream_blocks(st, out->tab, st->pending, n);
+	memmove(st->pending, st->pending + n, st->nr_pending - n);
+	memcpy(st->pending + st->nr_pending - n, in, length);
+	st->nr_pending = total - n;
+	return 1;
+    }
+    // Complete the pending block, then go on directly from in
+    r = (BLOCK_LENGTH - st->nr_pending % BLOCK_LENGTH) % BLOCK_LENGTH;
+    head = st->nr_pending + r;
+    memcpy(st->pending + st->nr_pending, in, r);
+    if(head > 0)
+	out->length = CBC_stream_blocks(st, out->tab, st->pending, head);
+    out->length += CBC_stream_blocks(st, out->tab + out->length, in + r, n - head);
+    st->nr_pending = total - n;
+    memcpy(st->pending, in + r + n - head, st->nr_pending);
+    return 1;
+}
+
+
+void aes_CBC_stream_clear(aes_cbc_stream_t *st){
+    aes_ctx_clear(&st->aes);
+    memset(st, 0, sizeof(aes_cbc_stream_t));
+}
+
+
+/* out = IV || IV */
+int aes_CBC_encrypt_init(aes_cbc_stream_t *st, buffer_t *out, buffer_t *key,
+			 buffer_t *IV, char mode){
+    if(key->length != BLOCK_LENGTH || IV->length != BLOCK_LENGTH){
+	perror("[aes_CBC_encrypt_init] ERROR: Key or IV do not have the good length.\n");
+	return 0;
+    }
+    if(mode != 's' && mode != 'R'){
+	perror("[aes_CBC_encrypt_init] ERROR: mode should be either 's' or 'R'.\n");
+	return 0;
+    }
+    if(!aes_ctx_init(&st->aes, key) || buffer_resize(out, 2 * BLOCK_LENGTH) == 0)
+	return 0;
+    sha3_init(&st->hash, HASH_LENGTH);
+    st->nr_pending = 0;
+    st->nr_blocks = 0;
+    st->mode = mode;
+    st->decrypt = 0;
+    memcpy(st->previous, IV->tab, BLOCK_LENGTH);
+    memcpy(out->tab, IV->tab, BLOCK_LENGTH);
+    memcpy(out->tab + BLOCK_LENGTH, IV->tab, BLOCK_LENGTH);
+    out->length = 2 * BLOCK_LENGTH;
+    sha3_update(&st->hash, out->tab, out->length);
+    return 1;
+}
+
+
+/* out = the cipher blocks completed by in[0..length[ */
+int aes_CBC_encrypt_update(aes_cbc_stream_t *st, buffer_t *out, uchar *in,
+			   size_t length){
+    return CBC_stream_feed(st, out, in, length, 0);
+}
+
+
+/* out = last block, padded, || tag; st is cleared */
+int aes_CBC_encrypt_final(aes_cbc_stream_t *st, buffer_t *out){
+    uchar last[BLOCK_LENGTH];
+    size_t np = st->nr_pending;
+    if(buffer_resize(out, BLOCK_LENGTH + HASH_LENGTH) == 0)
+	return 0;
+    memcpy(last, st->pending, np);
+    CBC_pad_block(last, np, st->mode);
+    CBC_stream_blocks(st, out->tab, last, BLOCK_LENGTH);
+    sha3_final(out->tab + BLOCK_LENGTH, &st->hash);
+    out->length = BLOCK_LENGTH + HASH_LENGTH;
+    memset(last, 0, BLOCK_LENGTH);
+    aes_CBC_stream_clear(st);
+    return 1;
+}
+
+
+int aes_CBC_decrypt_init(aes_cbc_stream_t *st, buffer_t *key, char mode){
+    if(key->length != BLOCK_LENGTH){
+	perror("[aes_CBC_decrypt_init] ERROR: Key does not have the good length.\n");
+	return 0;
+    }
+    if(mode != 's' && mode != 'R'){
+	perror("[aes_CBC_decrypt_init] ERROR: mode should be either 's' or 'R'.\n");
+	return 0;
+    }
+    if(!aes_ctx_init(&st->aes, key))
+	return 0;
+    sha3_init(&st->hash, HASH_LENGTH);
+    st->nr_pending = 0;
+    st->nr_blocks = 0;
+    st->mode = mode;
+    st->decrypt = 1;
+    return 1;
+}
+
+
+/* out = the plain text of the blocks completed by in[0..length[. The last
+   block and the tag are held back until aes_CBC_decrypt_final. */
+int aes_CBC_decrypt_update(aes_cbc_stream_t *st, buffer_t *out, uchar *in,
+			   size_t length){
+    return CBC_stream_feed(st, out, in, length, BLOCK_LENGTH + HASH_LENGTH);
+}
+
+
+/* out = last block without its padding; st is cleared. Returns 0 if
+   the input is not valid : the plain text given by the previous
+   updates must then be thrown away. */
+int aes_CBC_decrypt_final(aes_cbc_stream_t *st, buffer_t *out){
+    uchar last[BLOCK_LENGTH], tag[HASH_LENGTH], diff = 0;
+    size_t i;
+    int l = 0, ok = st->nr_pending == BLOCK_LENGTH + HASH_LENGTH && st->nr_blocks >= 2;
+    out->length = 0;
+    if(ok){
+	CBC_stream_blocks(st, last, st->pending, BLOCK_LENGTH);
+	sha3_final(tag, &st->hash);
+	for(i = 0; i < HASH_LENGTH; i++)
+	    diff |= tag[i] ^ st->pending[BLOCK_LENGTH + i];
+	ok = diff == 0;
+	if(!ok)
+	    perror("[aes_CBC_decrypt_final] ERROR: hash values differ.\n");
+    }
+    else
+	perror("[aes_CBC_decrypt_final] ERROR: Input is not a valid ciphertext.\n");
+
+    // Padding
+    if(ok){
+	l = CBC_unpad_block(last, st->mode);
+	ok = l >= 0;
+    }
+    if(ok && buffer_resize(out, BLOCK_LENGTH)){
+	memcpy(out->tab, last, l);
+	out->length = l;
+    }
+    memset(last, 0, BLOCK_LENGTH);
+    aes_CBC_stream_clear(st);
+    return ok;
+}
@@ -7,19 +7,75 @@
 /* Last modification October 8, 2018                          */
 /**************************************************************/
 
+#include "aes.h"
+#include "ghash.h"
+#include "sha3.h"
+
 /* Definitions */
 #define HASH_LENGTH 32
+#define MODES_MIN_THREAD_BLOCKS 4096 /* 64 KiB, below a thread costs more than it gives */
+#define MODES_BATCH 64 /* blocks encrypted or decrypted at once */
+#define MODES_SEGMENT_BLOCKS 4096 /* CBC with tag : blocks hashed and ciphered
+				     together, per thread, while in cache */
+#define GCM_IV_LENGTH 12
+#define GCM_TAG_LENGTH 16
+
+typedef struct{
+    aes_ctx_t aes;
+    ghash_key_t ghash;
+} aes_gcm_ctx_t;
+
+typedef struct{
+    aes_ctx_t aes;
+    sha3_ctx_t hash;              /* tag of what has been seen so far */
+    uchar previous[BLOCK_LENGTH]; /* last cipher block */
+    uchar pending[HASH_LENGTH + 2 * BLOCK_LENGTH]; /* not treated yet */
+    size_t nr_pending;
+    size_t nr_blocks;             /* blocks treated */
+    char mode;
+    int decrypt;
+} aes_cbc_stream_t;
 
 /* Functions */
 void pad(buffer_t *padded, buffer_t *in, char mode);
 void extract(buffer_t *out, buffer_t *padded, char mode);
+int aes_cbc_encrypt_inplace(aes_ctx_t *ctx, uchar IV[], uint8_t *data,
+			    size_t length);
+int aes_cbc_decrypt_inplace(aes_ctx_t *ctx, uchar IV[], uint8_t *data,
+			    size_t length);
 int aes_raw_CBC_encrypt(buffer_t *encrypted, buffer_t *in, buffer_t *key,
 						 buffer_t *IV);
 int aes_raw_CBC_decrypt(buffer_t *decrypted, buffer_t *in, buffer_t *key);
+int aes_raw_CBC_encrypt_ctx(buffer_t *encrypted, buffer_t *in, aes_ctx_t *ctx,
+			    buffer_t *IV);
+int aes_raw_CBC_decrypt_ctx(buffer_t *decrypted, buffer_t *in, aes_ctx_t *ctx);
 int aes_CBC_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
 					 buffer_t *IV, char mode);
 int aes_CBC_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key,
 					 char mode);
+int aes_CBC_encrypt_init(aes_cbc_stream_t *st, buffer_t *out, buffer_t *key,
+			 buffer_t *IV, char mode);
+int aes_CBC_encrypt_update(aes_cbc_stream_t *st, buffer_t *out, uchar *in,
+			   size_t length);
+int aes_CBC_encrypt_final(aes_cbc_stream_t *st, buffer_t *out);
+int aes_CBC_decrypt_init(aes_cbc_stream_t *st, buffer_t *key, char mode);
+int aes_CBC_decrypt_update(aes_cbc_stream_t *st, buffer_t *out, uchar *in,
+			   size_t length);
+int aes_CBC_decrypt_final(aes_cbc_stream_t *st, buffer_t *out);
+void aes_CBC_stream_clear(aes_cbc_stream_t *st);
+int aes_raw_CTR_ctx(buffer_t *out, buffer_t *in, aes_ctx_t *ctx, buffer_t *IV);
+int aes_CTR_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
+		    buffer_t *IV);
+int aes_CTR_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key);
+int aes_GCM_ctx_init(aes_gcm_ctx_t *ctx, buffer_t *key);
+void aes_GCM_ctx_clear(aes_gcm_ctx_t *ctx);
+int aes_raw_GCM_encrypt_ctx(buffer_t *encrypted, buffer_t *tag, buffer_t *in,
+			    buffer_t *aad, aes_gcm_ctx_t *ctx, buffer_t *IV);
+int aes_raw_GCM_decrypt_ctx(buffer_t *decrypted, buffer_t *in, buffer_t *tag,
+			    buffer_t *aad, aes_gcm_ctx_t *ctx, buffer_t *IV);
+int aes_GCM_encrypt(buffer_t *encrypted, buffer_t *plain, buffer_t *key,
+		    buffer_t *IV);
+int aes_GCM_decrypt(buffer_t *decrypted, buffer_t *encrypted, buffer_t *key);
 
 #define __FRS__MODES
 #endif
@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "base64.h"
 #include "gmp.h"
@@ -14,7 +15,7 @@
 
 // update the state with given number of rounds
 
-void sha3_keccakf(uint64_t st[25])
+void sha3_keccakf_ref(uint64_t st[25])
 {
     // constants
     const uint64_t keccakf_rndc[24] = {
@@ -104,6 +105,155 @@ void sha3_keccakf(uint64_t st[25])
 #endif
 }
 
+// Round constants, also used by the multi-buffer permutations
+
+const uint64_t keccakf_rc[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
+    0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
+    0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+    0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081,
+    0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
+
+#if KECCAK_UNROLLED
+// Fully unrolled permutation, two rounds per iteration with the state held
+// in 25 local lanes named after their row (b, g, k, m, s for y = 0..4) and
+// column (a, e, i, o, u for x = 0..4). The lane complementing transform of
+// the Keccak implementation overview (section 2.2) keeps lanes be, bi, go,
+// ki, mi and sa complemented between rounds, so that Chi needs one NOT per
+// row instead of five.
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#define LANE(x) __builtin_bswap64(x)
+#else
+#define LANE(x) (x)
+#endif
+
+// One round from the lanes A to the lanes E
+#define KECCAK_ROUND(A, E, rc) \
+    Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+    Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+    Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+    Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+    Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+    Da = Cu ^ ROTL64(Ce, 1); \
+    De = Ca ^ ROTL64(Ci, 1); \
+    Di = Ce ^ ROTL64(Co, 1); \
+    Do = Ci ^ ROTL64(Cu, 1); \
+    Du = Co ^ ROTL64(Ca, 1); \
+    \
+    Ba = A##ba ^ Da; \
+    Be = ROTL64(A##ge ^ De, 44); \
+    Bi = ROTL64(A##ki ^ Di, 43); \
+    Bo = ROTL64(A##mo ^ Do, 21); \
+    Bu = ROTL64(A##su ^ Du, 14); \
+    E##ba = Ba ^ (Be | Bi) ^ (rc); \
+    E##be = Be ^ (~Bi | Bo); \
+    E##bi = Bi ^ (Bo & Bu); \
+    E##bo = Bo ^ (Bu | Ba); \
+    E##bu = Bu ^ (Ba & Be); \
+    \
+    Ba = ROTL64(A##bo ^ Do, 28); \
+    Be = ROTL64(A##gu ^ Du, 20); \
+    Bi = ROTL64(A##ka ^ Da, 3); \
+    Bo = ROTL64(A##me ^ De, 45); \
+    Bu = ROTL64(A##si ^ Di, 61); \
+    E##ga = Ba ^ (Be | Bi); \
+    E##ge = Be ^ (Bi & Bo); \
+    E##gi = Bi ^ (Bo | ~Bu); \
+    E##go = Bo ^ (Bu | Ba); \
+    E##gu = Bu ^ (Ba & Be); \
+    \
+    Ba = ROTL64(A##be ^ De, 1); \
+    Be = ROTL64(A##gi ^ Di, 6); \
+    Bi = ROTL64(A##ko ^ Do, 25); \
+    Bo = ROTL64(A##mu ^ Du, 8); \
+    Bu = ROTL64(A##sa ^ Da, 18); \
+    E##ka = Ba ^ (Be | Bi); \
+    E##ke = Be ^ (Bi & Bo); \
+    E##ki = Bi ^ (~Bo & Bu); \
+    E##ko = ~Bo ^ (Bu | Ba); \
+    E##ku = Bu ^ (Ba & Be); \
+    \
+    Ba = ROTL64(A##bu ^ Du, 27); \
+    Be = ROTL64(A##ga ^ Da, 36); \
+    Bi = ROTL64(A##ke ^ De, 10); \
+    Bo = ROTL64(A##mi ^ Di, 15); \
+    Bu = ROTL64(A##so ^ Do, 56); \
+    E##ma = Ba ^ (Be & Bi); \
+    E##me = Be ^ (Bi | Bo); \
+    E##mi = Bi ^ (~Bo | Bu); \
+    E##mo = ~Bo ^ (Bu & Ba); \
+    E##mu = Bu ^ (Ba | Be); \
+    \
+    Ba = ROTL64(A##bi ^ Di, 62); \
+    Be = ROTL64(A##go ^ Do, 55); \
+    Bi = ROTL64(A##ku ^ Du, 39); \
+    Bo = ROTL64(A##ma ^ Da, 41); \
+    Bu = ROTL64(A##se ^ De, 2); \
+    E##sa = Ba ^ (~Be & Bi); \
+    E##se = ~Be ^ (Bi | Bo); \
+    E##si = Bi ^ (Bo & Bu); \
+    E##so = Bo ^ (Bu | Ba); \
+    E##su = Bu ^ (Ba & Be);
+
+void sha3_keccakf(uint64_t st[25])
+{
+    uint64_t Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu,
+        Aka, Ake, Aki, Ako, Aku, Ama, Ame, Ami, Amo, Amu,
+        Asa, Ase, Asi, Aso, Asu;
+    uint64_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu,
+        Eka, Eke, Eki, Eko, Eku, Ema, Eme, Emi, Emo, Emu,
+        Esa, Ese, Esi, Eso, Esu;
+    uint64_t Ba, Be, Bi, Bo, Bu, Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du;
+    int r;
+
+    Aba = LANE(st[0]);   Abe = ~LANE(st[1]);  Abi = ~LANE(st[2]);
+    Abo = LANE(st[3]);   Abu = LANE(st[4]);   Aga = LANE(st[5]);
+    Age = LANE(st[6]);   Agi = LANE(st[7]);   Ago = ~LANE(st[8]);
+    Agu = LANE(st[9]);   Aka = LANE(st[10]);  Ake = LANE(st[11]);
+    Aki = ~LANE(st[12]); Ako = LANE(st[13]);  Aku = LANE(st[14]);
+    Ama = LANE(st[15]);  Ame = LANE(st[16]);  Ami = ~LANE(st[17]);
+    Amo = LANE(st[18]);  Amu = LANE(st[19]);  Asa = ~LANE(st[20]);
+    Ase = LANE(st[21]);  Asi = LANE(st[22]);  Aso = LANE(st[23]);
+    Asu = LANE(st[24]);
+
+    for (r = 0; r < KECCAKF_ROUNDS; r += 2) {
+        KECCAK_ROUND(A, E, keccakf_rc[r])
+        KECCAK_ROUND(E, A, keccakf_rc[r + 1])
+    }
+
+    st[0] = LANE(Aba);   st[1] = LANE(~Abe);  st[2] = LANE(~Abi);
+    st[3] = LANE(Abo);   st[4] = LANE(Abu);   st[5] = LANE(Aga);
+    st[6] = LANE(Age);   st[7] = LANE(Agi);   st[8] = LANE(~Ago);
+    st[9] = LANE(Agu);   st[10] = LANE(Aka);  st[11] = LANE(Ake);
+    st[12] = LANE(~Aki); st[13] = LANE(Ako);  st[14] = LANE(Aku);
+    st[15] = LANE(Ama);  st[16] = LANE(Ame);  st[17] = LANE(~Ami);
+    st[18] = LANE(Amo);  st[19] = LANE(Amu);  st[20] = LANE(~Asa);
+    st[21] = LANE(Ase);  st[22] = LANE(Asi);  st[23] = LANE(Aso);
+    st[24] = LANE(Asu);
+}
+#else
+void sha3_keccakf(uint64_t st[25])
+{
+    sha3_keccakf_ref(st);
+}
+#endif
+
+// Which permutation sha3_keccakf() is
+
+const char *sha3_engine(void)
+{
+#if KECCAK_UNROLLED
+    return "unrolled, lane complementing";
+#else
+    return "reference loop";
+#endif
+}
+
 // Initialize the context for SHA3
 
 int sha3_init(sha3_ctx_t *c, int mdlen)
@@ -121,14 +271,37 @@ int sha3_init(sha3_ctx_t *c, int mdlen)
 
 // update state with more data
 
+// Input is XORed into the state a whole 64-bit lane at a time, and a whole rate
+// block at a time when a block starts, with bytes only for the head and tail.
+// A native load XORed into st.q[] is the same as a byte-wise XOR into st.b[],
+// so no endianness conversion is needed. The rate is a multiple of 8 for all
+// the SHA-3 and SHAKE sizes; other digest lengths stay on the byte path.
+
 int sha3_update(sha3_ctx_t *c, const void *data, size_t len)
 {
-    size_t i;
-    int j;
+    const uint8_t *in = (const uint8_t *) data;
+    size_t i = 0;
+    int j, k, lanes = c->rsiz % 8 == 0 ? c->rsiz / 8 : 0;
+    uint64_t t;
 
     j = c->pt;
-    for (i = 0; i < len; i++) {
-        c->st.b[j++] ^= ((const uint8_t *) data)[i];
+    while (i < len) {
+        if (j == 0 && lanes > 0 && len - i >= (size_t) c->rsiz) {
+            for (k = 0; k < lanes; k++, i += 8) {
+                memcpy(&t, in + i, 8);
+                c->st.q[k] ^= t;
+            }
+            sha3_keccakf(c->st.q);
+            continue;
+        }
+        if ((j & 7) == 0 && j + 8 <= c->rsiz && len - i >= 8) {
+            memcpy(&t, in + i, 8);
+            c->st.q[j / 8] ^= t;
+            i += 8;
+            j += 8;
+        }
+        else
+            c->st.b[j++] ^= in[i++];
         if (j >= c->rsiz) {
             sha3_keccakf(c->st.q);
             j = 0;
@@ -170,13 +343,35 @@ void sha3(const void *in, size_t inlen, void *md, int mdlen)
 }
 
 
-// SHA-3 hash of a buffer in written in a buffer out
+// SHA-3 hash of a buffer in written in a buffer out, straight into out->tab
 void buffer_hash(buffer_t *out, int out_length, buffer_t *in){
-	buffer_reset(out);
-	unsigned char *out_tab = malloc(out_length * sizeof(unsigned char));
-	sha3(in->tab, in->length, out_tab, out_length);
-	buffer_from_string(out, out_tab, out_length);
-	free(out_tab);
+	out->length = 0;
+	if(out_length <= 0 || out_length > SHA3_MAX_MDLEN){
+		perror("[buffer_hash] : Digest length out of range.\n");
+		return;
+	}
+	if(buffer_resize(out, out_length) == 0)
+		return;
+	sha3(in->tab, in->length, out->tab, out_length);
+	out->length = out_length;
+}
+
+// SHA-3 hash read as a big-endian integer, the digest stays on the stack
+int sha3_to_mpz(mpz_t h, int mdlen, const void *in, size_t inlen)
+{
+    uint8_t md[SHA3_MAX_MDLEN];
+
+    if (mdlen <= 0 || mdlen > SHA3_MAX_MDLEN) {
+        perror("[sha3_to_mpz] : Digest length out of range.\n");
+        return 0;
+    }
+    sha3(in, inlen, md, mdlen);
+    mpz_import(h, mdlen, 1, 1, 1, 0, md);
+    return 1;
+}
+
+int buffer_hash_to_mpz(mpz_t h, int out_length, buffer_t *in){
+	return sha3_to_mpz(h, out_length, in->tab, in->length);
 }
 
 // SHAKE128 and SHAKE256 extensible-output functionality
@@ -191,16 +386,21 @@ void shake_xof(sha3_ctx_t *c)
 
 void shake_out(sha3_ctx_t *c, void *out, size_t len)
 {
-    size_t i;
+    size_t i, n;
     int j;
 
+    // copy out what is left of the rate, one block at a time
     j = c->pt;
-    for (i = 0; i < len; i++) {
+    for (i = 0; i < len; i += n) {
         if (j >= c->rsiz) {
             sha3_keccakf(c->st.q);
             j = 0;
         }
-        ((uint8_t *) out)[i] = c->st.b[j++];
+        n = (size_t) (c->rsiz - j);
+        if (n > len - i)
+            n = len - i;
+        memcpy((uint8_t *) out + i, &c->st.b[j], n);
+        j += (int) n;
     }
     c->pt = j;
 }
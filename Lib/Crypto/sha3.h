@@ -24,8 +24,17 @@ typedef struct {
     int pt, rsiz, mdlen;                    // these don't overflow
 } sha3_ctx_t;
 
+// Keccak-f[1600]: fully unrolled with lane complementing unless
+// KECCAK_UNROLLED is 0, the reference loop is kept for comparison.
+#ifndef KECCAK_UNROLLED
+#define KECCAK_UNROLLED 1
+#endif
+
 // Compression function.
 void sha3_keccakf(uint64_t st[25]);
+void sha3_keccakf_ref(uint64_t st[25]);
+extern const uint64_t keccakf_rc[24];
+const char *sha3_engine(void);
 
 // OpenSSL - like interfece
 int sha3_init(sha3_ctx_t *c, int mdlen);    // mdlen = hash output in bytes
@@ -38,6 +47,13 @@ int sha3_final(void *md, sha3_ctx_t *c);    // digest goes to md
 // SHA-3 has of a buffer in written in a buffer out
 void buffer_hash(buffer_t *out, int out_length, buffer_t *in);
 
+// SHA-3 hash as a big-endian integer, as mpz_import() of buffer_hash() would
+// give, without any allocation but that of h; 0 if mdlen > SHA3_MAX_MDLEN,
+// the largest length for which the rate 200 - 2 * mdlen stays positive
+#define SHA3_MAX_MDLEN 99
+int sha3_to_mpz(mpz_t h, int mdlen, const void *in, size_t inlen);
+int buffer_hash_to_mpz(mpz_t h, int out_length, buffer_t *in);
+
 // SHAKE128 and SHAKE256 extensible-output functions
 #define shake128_init(c) sha3_init(c, 16)
 #define shake256_init(c) sha3_init(c, 32)
@@ -0,0 +1,429 @@
+/**************************************************************/
+/* sha3_multi.c                                               */
+/* Multi-buffer SHA-3: the Keccak states of 4 (AVX2) or 8     */
+/* (AVX-512) messages are interleaved, lane k of message m    */
+/* being st[W * k + m], and permuted together.                */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "sha3.h"
+#include "sha3_multi.h"
+
+/* Padding suffixes of SHA-3 and SHAKE */
+#define SUFFIX_SHA3 0x06
+#define SUFFIX_SHAKE 0x1f
+
+/* Digest of one message, the fallback: SHA-3 on outlen bytes, or outlen
+   bytes of SHAKE256 */
+static void sha3_one(uint8_t *md, const uint8_t *in, size_t len, int outlen,
+		     uint8_t suffix){
+    sha3_ctx_t c;
+    if(suffix == SUFFIX_SHAKE){
+	shake256_init(&c);
+	shake_update(&c, in, len);
+	shake_xof(&c);
+	shake_out(&c, md, outlen);
+	return;
+    }
+    sha3_init(&c, outlen);
+    sha3_update(&c, in, len);
+    sha3_final(md, &c);
+}
+
+#if SHA3_SIMD
+
+/* One round from the lanes A to the lanes E, same lane names and order as
+   sha3_keccakf(), without lane complementing since both instruction sets
+   have and-not. XOR, XOR5, ROL and CHI (a ^ (~b & c)) are defined for each
+   instruction set below. */
+#define KECCAK_ROUND_V(A, E, rc) \
+    Ca = XOR5(A##ba, A##ga, A##ka, A##ma, A##sa); \
+    Ce = XOR5(A##be, A##ge, A##ke, A##me, A##se); \
+    Ci = XOR5(A##bi, A##gi, A##ki, A##mi, A##si); \
+    Co = XOR5(A##bo, A##go, A##ko, A##mo, A##so); \
+    Cu = XOR5(A##bu, A##gu, A##ku, A##mu, A##su); \
+    Da = XOR(Cu, ROL(Ce, 1)); \
+    De = XOR(Ca, ROL(Ci, 1)); \
+    Di = XOR(Ce, ROL(Co, 1)); \
+    Do = XOR(Ci, ROL(Cu, 1)); \
+    Du = XOR(Co, ROL(Ca, 1)); \
+    \
+    Ba = XOR(A##ba, Da); \
+    Be = ROL(XOR(A##ge, De), 44); \
+    Bi = ROL(XOR(A##ki, Di), 43); \
+    Bo = ROL(XOR(A##mo, Do), 21); \
+    Bu = ROL(XOR(A##su, Du), 14); \
+    E##ba = XOR(CHI(Ba, Be, Bi), rc); \
+    E##be = CHI(Be, Bi, Bo); \
+    E##bi = CHI(Bi, Bo, Bu); \
+    E##bo = CHI(Bo, Bu, Ba); \
+    E##bu = CHI(Bu, Ba, Be); \
+    \
+    Ba = ROL(XOR(A##bo, Do), 28); \
+    Be = ROL(XOR(A##gu, Du), 20); \
+    Bi = ROL(XOR(A##ka, Da), 3); \
+    Bo = ROL(XOR(A##me, De), 45); \
+    Bu = ROL(XOR(A##si, Di), 61); \
+    E##ga = CHI(Ba, Be, Bi); \
+    E##ge = CHI(Be, Bi, Bo); \
+    E##gi = CHI(Bi, Bo, Bu); \
+    E##go = CHI(Bo, Bu, Ba); \
+    E##gu = CHI(Bu, Ba, Be); \
+    \
+    Ba = ROL(XOR(A##be, De), 1); \
+    Be = ROL(XOR(A##gi, Di), 6); \
+    Bi = ROL(XOR(A##ko, Do), 25); \
+    Bo = ROL(XOR(A##mu, Du), 8); \
+    Bu = ROL(XOR(A##sa, Da), 18); \
+    E##ka = CHI(Ba, Be, Bi); \
+    E##ke = CHI(Be, Bi, Bo); \
+    E##ki = CHI(Bi, Bo, Bu); \
+    E##ko = CHI(Bo, Bu, Ba); \
+    E##ku = CHI(Bu, Ba, Be); \
+    \
+    Ba = ROL(XOR(A##bu, Du), 27); \
+    Be = ROL(XOR(A##ga, Da), 36); \
+    Bi = ROL(XOR(A##ke, De), 10); \
+    Bo = ROL(XOR(A##mi, Di), 15); \
+    Bu = ROL(XOR(A##so, Do), 56); \
+    E##ma = CHI(Ba, Be, Bi); \
+    E##me = CHI(Be, Bi, Bo); \
+    E##mi = CHI(Bi, Bo, Bu); \
+    E##mo = CHI(Bo, Bu, Ba); \
+    E##mu = CHI(Bu, Ba, Be); \
+    \
+    Ba = ROL(XOR(A##bi, Di), 62); \
+    Be = ROL(XOR(A##go, Do), 55); \
+    Bi = ROL(XOR(A##ku, Du), 39); \
+    Bo = ROL(XOR(A##ma, Da), 41); \
+    Bu = ROL(XOR(A##se, De), 2); \
+    E##sa = CHI(Ba, Be, Bi); \
+    E##se = CHI(Be, Bi, Bo); \
+    E##si = CHI(Bi, Bo, Bu); \
+    E##so = CHI(Bo, Bu, Ba); \
+    E##su = CHI(Bu, Ba, Be);
+
+#define KECCAK_LANES(T) \
+    T Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, \
+      Aka, Ake, Aki, Ako, Aku, Ama, Ame, Ami, Amo, Amu, \
+      Asa, Ase, Asi, Aso, Asu; \
+    T Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, \
+      Eka, Eke, Eki, Eko, Eku, Ema, Eme, Emi, Emo, Emu, \
+      Esa, Ese, Esi, Eso, Esu; \
+    T Ba, Be, Bi, Bo, Bu, Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du;
+
+#define KECCAK_LOAD(st, W) \
+    Aba = LOAD(st + 0 * W); \
+    Abe = LOAD(st + 1 * W); \
+    Abi = LOAD(st + 2 * W); \
+    Abo = LOAD(st + 3 * W); \
+    Abu = LOAD(st + 4 * W); \
+    Aga = LOAD(st + 5 * W); \
+    Age = LOAD(st + 6 * W); \
+    Agi = LOAD(st + 7 * W); \
+    Ago = LOAD(st + 8 * W); \
+    Agu = LOAD(st + 9 * W); \
+    Aka = LOAD(st + 10 * W); \
+    Ake = LOAD(st + 11 * W); \
+    Aki = LOAD(st + 12 * W); \
+    Ako = LOAD(st + 13 * W); \
+    Aku = LOAD(st + 14 * W); \
+    Ama = LOAD(st + 15 * W); \
+    Ame = LOAD(st + 16 * W); \
+    Ami = LOAD(st + 17 * W); \
+    Amo = LOAD(st + 18 * W); \
+    Amu = LOAD(st + 19 * W); \
+    Asa = LOAD(st + 20 * W); \
+    Ase = LOAD(st + 21 * W); \
+    Asi = LOAD(st + 22 * W); \
+    Aso = LOAD(st + 23 * W); \
+    Asu = LOAD(st + 24 * W);
+
+#define KECCAK_STORE(st, W) \
+    STORE(st + 0 * W, Aba); \
+    STORE(st + 1 * W, Abe); \
+    STORE(st + 2 * W, Abi); \
+    STORE(st + 3 * W, Abo); \
+    STORE(st + 4 * W, Abu); \
+    STORE(st + 5 * W, Aga); \
+    STORE(st + 6 * W, Age); \
+    STORE(st + 7 * W, Agi); \
+    STORE(st + 8 * W, Ago); \
+    STORE(st + 9 * W, Agu); \
+    STORE(st + 10 * W, Aka); \
+    STORE(st + 11 * W, Ake); \
+    STORE(st + 12 * W, Aki); \
+    STORE(st + 13 * W, Ako); \
+    STORE(st + 14 * W, Aku); \
+    STORE(st + 15 * W, Ama); \
+    STORE(st + 16 * W, Ame); \
+    STORE(st + 17 * W, Ami); \
+    STORE(st + 18 * W, Amo); \
+    STORE(st + 19 * W, Amu); \
+    STORE(st + 20 * W, Asa); \
+    STORE(st + 21 * W, Ase); \
+    STORE(st + 22 * W, Asi); \
+    STORE(st + 23 * W, Aso); \
+    STORE(st + 24 * W, Asu);
+
+/* 1 if the processor and the system support AVX2, resp. AVX-512F */
+static int avx2_available(void){
+    static int available = -1;
+    if(available < 0)
+	available = __builtin_cpu_supports("avx2") != 0;
+    return available;
+}
+
+static int avx512_available(void){
+    static int available = -1;
+    if(available < 0)
+	available = __builtin_cpu_supports("avx512f") != 0;
+    return available;
+}
+
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+#define XOR(a, b) _mm256_xor_si256(a, b)
+#define XOR5(a, b, c, d, e) XOR(XOR(XOR(a, b), XOR(c, d)), e)
+#define ROL(x, n) _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - (n)))
+#define CHI(a, b, c) XOR(a, _mm256_andnot_si256(b, c))
+#define LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+
+static void keccakf_x4(uint64_t st[])
+{
+    KECCAK_LANES(__m256i)
+    int r;
+
+    KECCAK_LOAD(st, 4)
+    for (r = 0; r < 24; r += 2) {
+        KECCAK_ROUND_V(A, E, _mm256_set1_epi64x(keccakf_rc[r]))
+        KECCAK_ROUND_V(E, A, _mm256_set1_epi64x(keccakf_rc[r + 1]))
+    }
+    KECCAK_STORE(st, 4)
+}
+
+#undef XOR
+#undef XOR5
+#undef ROL
+#undef CHI
+#undef LOAD
+#undef STORE
+#pragma GCC pop_options
+
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+/* Three-way XOR and Chi are single ternary logic instructions */
+#define XOR(a, b) _mm512_xor_si512(a, b)
+#define XOR5(a, b, c, d, e) \
+    _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a, b, c, 0x96), d, e, 0x96)
+#define ROL(x, n) _mm512_rol_epi64(x, n)
+#define CHI(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xd2)
+#define LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+
+static void keccakf_x8(uint64_t st[])
+{
+    KECCAK_LANES(__m512i)
+    int r;
+
+    KECCAK_LOAD(st, 8)
+    for (r = 0; r < 24; r += 2) {
+        KECCAK_ROUND_V(A, E, _mm512_set1_epi64(keccakf_rc[r]))
+        KECCAK_ROUND_V(E, A, _mm512_set1_epi64(keccakf_rc[r + 1]))
+    }
+    KECCAK_STORE(st, 8)
+}
+
+#undef XOR
+#undef XOR5
+#undef ROL
+#undef CHI
+#undef LOAD
+#undef STORE
+#pragma GCC pop_options
+
+
+/* Absorbs the W messages block by block, all the states being permuted
+   together. A message that ends earlier has its digest squeezed right after
+   its last block, the permutations after that are wasted on its lane.
+   Needs a rate multiple of 8 and a little endian processor. */
+static void sha3_multi(int W, void (*permute)(uint64_t *), uint8_t *md[],
+		       const uint8_t *in[], const size_t len[], int rsiz,
+		       int outlen, uint8_t suffix){
+    uint64_t st[25 * 8], t;
+    uint8_t last[200];
+    size_t blocks[8], nr_blocks = 0, b;
+    int m, k;
+
+    memset(st, 0, sizeof(st));
+    for(m = 0; m < W; m++){
+	blocks[m] = len[m] / rsiz + 1;
+	if(blocks[m] > nr_blocks)
+	    nr_blocks = blocks[m];
+    }
+    for(b = 0; b < nr_blocks; b++){
+	for(m = 0; m < W; m++){
+	    if(b >= blocks[m])
+		continue;
+	    const uint8_t *p = in[m] + b * rsiz;
+	    if(b == blocks[m] - 1){
+		// padding, as in sha3_final() and shake_xof()
+		memset(last, 0, rsiz);
+		memcpy(last, p, len[m] - b * rsiz);
+		last[len[m] - b * rsiz] ^= suffix;
+		last[rsiz - 1] ^= 0x80;
+		p = last;
+	    }
+	    for(k = 0; k < rsiz / 8; k++){
+		memcpy(&t, p + 8 * k, 8);
+		st[W * k + m] ^= t;
+	    }
+	}
+	permute(st);
+	for(m = 0; m < W; m++)
+	    if(b == blocks[m] - 1)
+		for(k = 0; k < outlen; k++)
+		    md[m][k] = (uint8_t)(st[W * (k / 8) + m] >> (8 * (k % 8)));
+    }
+}
+
+#endif
+
+
+/* sha3_multi() squeezes a single block : outlen must fit in the rate */
+static int simd_usable(int rsiz, int outlen){
+#if SHA3_SIMD && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return rsiz > 0 && rsiz % 8 == 0 && outlen > 0 && outlen <= rsiz;
+#else
+    return 0;
+#endif
+}
+
+
+static void keccak_x4(uint8_t *md[4], const uint8_t *in[4], const size_t len[4],
+		      int rsiz, int outlen, uint8_t suffix){
+#if SHA3_SIMD
+    if(simd_usable(rsiz, outlen) && avx2_available()){
+	sha3_multi(4, keccakf_x4, md, in, len, rsiz, outlen, suffix);
+	return;
+    }
+#endif
+    for(int m = 0; m < 4; m++)
+	sha3_one(md[m], in[m], len[m], outlen, suffix);
+}
+
+
+static void keccak_x8(uint8_t *md[8], const uint8_t *in[8], const size_t len[8],
+		      int rsiz, int outlen, uint8_t suffix){
+#if SHA3_SIMD
+    if(simd_usable(rsiz, outlen) && avx512_available()){
+	sha3_multi(8, keccakf_x8, md, in, len, rsiz, outlen, suffix);
+	return;
+    }
+#endif
+    keccak_x4(md, in, len, rsiz, outlen, suffix);
+    keccak_x4(md + 4, in + 4, len + 4, rsiz, outlen, suffix);
+}
+
+
+static void keccak_batch(uint8_t *md[], const uint8_t *in[], const size_t len[],
+			 size_t n, int rsiz, int outlen, uint8_t suffix){
+    int width = simd_usable(rsiz, outlen) ? sha3_batch_width() : 1;
+    size_t i = 0;
+    if(width == 8)
+	for(; i + 8 <= n; i += 8)
+	    keccak_x8(md + i, in + i, len + i, rsiz, outlen, suffix);
+    if(width >= 4)
+	for(; i + 4 <= n; i += 4)
+	    keccak_x4(md + i, in + i, len + i, rsiz, outlen, suffix);
+    for(; i < n; i++)
+	sha3_one(md[i], in[i], len[i], outlen, suffix);
+}
+
+
+void sha3_x4(uint8_t *md[4], const uint8_t *in[4], const size_t len[4], int mdlen){
+    keccak_x4(md, in, len, 200 - 2 * mdlen, mdlen, SUFFIX_SHA3);
+}
+
+
+void sha3_x8(uint8_t *md[8], const uint8_t *in[8], const size_t len[8], int mdlen){
+    keccak_x8(md, in, len, 200 - 2 * mdlen, mdlen, SUFFIX_SHA3);
+}
+
+
+int sha3_batch_width(void){
+#if SHA3_SIMD
+    if(avx512_available())
+	return 8;
+    if(avx2_available())
+	return 4;
+#endif
+    return 1;
+}
+
+
+const char *sha3_multi_engine(void){
+    switch(sha3_batch_width()){
+    case 8:
+	return "AVX-512, 8 messages";
+    case 4:
+	return "AVX2, 4 messages";
+    default:
+	return "one message at a time";
+    }
+}
+
+
+void sha3_batch(uint8_t *md[], const uint8_t *in[], const size_t len[], size_t n,
+		int mdlen){
+    keccak_batch(md, in, len, n, 200 - 2 * mdlen, mdlen, SUFFIX_SHA3);
+}
+
+
+/* Up to 136 bytes, the rate, the digests are squeezed in the lanes; longer
+   ones need more permutations and are computed one message at a time */
+void shake256_batch(uint8_t *md[], const uint8_t *in[], const size_t len[],
+		    size_t n, int outlen){
+    keccak_batch(md, in, len, n, 136, outlen, SUFFIX_SHAKE);
+}
+
+
+/* Same as buffer_hash() for each in[i], 8 at a time, the digests being
+   written directly in out[i]; out[] and in[] must not share buffers */
+void buffer_hash_batch(buffer_t out[], int out_length, buffer_t in[], size_t n){
+    uint8_t *md[8];
+    const uint8_t *tab[8];
+    size_t len[8], i, j, count;
+    for(i = 0; i < n; i++)
+	out[i].length = 0;
+    if(out_length <= 0 || out_length > SHA3_MAX_MDLEN){
+	perror("[buffer_hash_batch] : Digest length out of range.\n");
+	return;
+    }
+    for(i = 0; i < n; i += count){
+	count = n - i < 8 ? n - i : 8;
+	for(j = 0; j < count; j++){
+	    if(buffer_set_length(&out[i + j], out_length) == 0){
+		for(j = 0; j < n; j++)
+		    out[j].length = 0;
+		return;
+	    }
+	    md[j] = out[i + j].tab;
+	    tab[j] = in[i + j].tab;
+	    len[j] = in[i + j].length;
+	}
+	sha3_batch(md, tab, len, count, out_length);
+    }
+}
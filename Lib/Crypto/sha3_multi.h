@@ -0,0 +1,37 @@
+#ifndef __FRS__SHA3_MULTI
+
+/**************************************************************/
+/* sha3_multi.h                                               */
+/* SHA-3 of 4 or 8 independent messages at once, one Keccak   */
+/* state per 64-bit SIMD lane (AVX2, AVX-512), chosen at run  */
+/* time with a one message at a time fallback.                */
+/**************************************************************/
+
+/* Set SHA3_SIMD to 0 to build without the vector code */
+#ifndef SHA3_SIMD
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA3_SIMD 1
+#else
+#define SHA3_SIMD 0
+#endif
+#endif
+
+/* md[i] = SHA3(in[i]) on mdlen bytes, messages may have different lengths */
+void sha3_x4(uint8_t *md[4], const uint8_t *in[4], const size_t len[4], int mdlen);
+void sha3_x8(uint8_t *md[8], const uint8_t *in[8], const size_t len[8], int mdlen);
+
+/* Any number of messages, in groups of 8 or 4 when possible */
+void sha3_batch(uint8_t *md[], const uint8_t *in[], const size_t len[], size_t n,
+		int mdlen);
+void buffer_hash_batch(buffer_t out[], int out_length, buffer_t in[], size_t n);
+
+/* Same with outlen bytes of SHAKE256, in groups only up to 136 bytes */
+void shake256_batch(uint8_t *md[], const uint8_t *in[], const size_t len[],
+		    size_t n, int outlen);
+
+/* Messages hashed at once by sha3_batch(), and how */
+int sha3_batch_width(void);
+const char *sha3_multi_engine(void);
+
+#define __FRS__SHA3_MULTI
+#endif
@@ -0,0 +1,328 @@
+/**************************************************************/
+/* sha3_tree.c                                                */
+/* ParallelHash256 (NIST SP 800-185, section 6) : the input   */
+/* is cut into leaves of B bytes, each leaf is hashed with    */
+/* SHAKE256 into 64 bytes, and the chaining values are hashed */
+/* in order by cSHAKE256 with N = "ParallelHash".             */
+/**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gmp.h"
+#include "buffer.h"
+#include "parallel.h"
+#include "sha3.h"
+#include "sha3_multi.h"
+#include "sha3_tree.h"
+
+#define CV_LENGTH 64 /* chaining values of 512 bits */
+
+/********************/
+/* cSHAKE256        */
+/********************/
+
+/* left_encode() and right_encode() of SP 800-185, section 2.3.1 */
+static size_t left_encode(uint8_t out[9], uint64_t x){
+    size_t n = 1, i;
+    while(n < 8 && (x >> (8 * n)) != 0)
+	n++;
+    out[0] = (uint8_t)n;
+    for(i = 1; i <= n; i++)
+	out[i] = (uint8_t)(x >> (8 * (n - i)));
+    return n + 1;
+}
+
+
+static size_t right_encode(uint8_t out[9], uint64_t x){
+    size_t n = left_encode(out, x);
+    memmove(out, out + 1, n - 1);
+    out[n - 1] = (uint8_t)(n - 1);
+    return n;
+}
+
+
+/* Absorbs bytepad(encode_string(N) || encode_string(S), 136) */
+static void cshake256_init(sha3_ctx_t *c, const char *N, const uint8_t *S,
+			   size_t slen){
+    static const uint8_t zeros[136] = {0};
+    uint8_t e[9];
+    size_t nlen = strlen(N), total = 0, n;
+
+    shake256_init(c);
+    n = left_encode(e, c->rsiz);
+    shake_update(c, e, n);
+    total += n;
+    n = left_encode(e, 8 * (uint64_t)nlen);
+    shake_update(c, e, n);
+    shake_update(c, N, nlen);
+    total += n + nlen;
+    n = left_encode(e, 8 * (uint64_t)slen);
+    shake_update(c, e, n);
+    shake_update(c, S, slen);
+    total += n + slen;
+    shake_update(c, zeros, (c->rsiz - total % c->rsiz) % c->rsiz);
+}
+
+
+/* Padding 00 || 10*1 instead of 1111 || 10*1 for SHAKE */
+static void cshake256_final(sha3_ctx_t *c, uint8_t *out, size_t len){
+    c->st.b[c->pt] ^= 0x04;
+    c->st.b[c->rsiz - 1] ^= 0x80;
+    sha3_keccakf(c->st.q);
+    c->pt = 0;
+    shake_out(c, out, len);
+}
+
+
+/********************/
+/* Leaves           */
+/********************/
+
+typedef struct{
+    const uint8_t *in;
+    size_t length;  /* in bytes, a multiple of B but for the last leaf */
+    size_t B;
+    uint8_t *cv;    /* CV_LENGTH bytes per leaf */
+} leaves_t;
+
+
+/* SHAKE256 of each leaf, as many at once as the multi-buffer code allows */
+static void *hash_leaves(void *arg){
+    leaves_t *l = (leaves_t *)arg;
+    size_t nr_leaves = (l->length + l->B - 1) / l->B, i, j, count;
+    uint8_t *md[64];
+    const uint8_t *in[64];
+    size_t len[64];
+    for(i = 0; i < nr_leaves; i += count){
+	count = nr_leaves - i < 64 ? nr_leaves - i : 64;
+	for(j = 0; j < count; j++){
+	    size_t first = (i + j) * l->B;
+	    in[j] = l->in + first;
+	    len[j] = l->length - first < l->B ? l->length - first : l->B;
+	    md[j] = l->cv + (i + j) * CV_LENGTH;
+	}
+	shake256_batch(md, in, len, count, CV_LENGTH);
+    }
+    return NULL;
+}
+
+
+/* Chaining values of the leaves of in, computed on several threads */
+static void tree_leaves(uint8_t *cv, const uint8_t *in, size_t length, size_t B){
+    size_t nr_leaves = (length + B - 1) / B;
+    size_t nr_threads = parallel_nr_threads();
+    if(nr_threads > nr_leaves / SHA3_TREE_MIN_THREAD_LEAVES)
+	nr_threads = nr_leaves / SHA3_TREE_MIN_THREAD_LEAVES;
+    if(nr_threads <= 1){
+	leaves_t all = {in, length, B, cv};
+	hash_leaves(&all);
+	return;
+    }
+
+    // 1. Consecutive leaves for each thread
+    leaves_t part[PARALLEL_MAX_THREADS];
+    size_t t;
+    for(t = 0; t < nr_threads; t++){
+	size_t first = t * nr_leaves / nr_threads;
+	size_t last = (t + 1) * nr_leaves / nr_threads;
+	part[t].in = in + first * B;
+	part[t].length = (last == nr_leaves ? length : last * B) - first * B;
+	part[t].B = B;
+	part[t].cv = cv + first * CV_LENGTH;
+    }
+
+    // 2. Hash them
+    parallel_run(hash_leaves, part, sizeof(leaves_t), (int)nr_threads);
+}
+
+
+/********************/
+/* The tree         */
+/********************/
+
+typedef struct{
+    sha3_ctx_t root;     /* cSHAKE256 of the chaining values */
+    size_t B;
+    uint64_t nr_leaves;
+    uint8_t *cv;         /* room for the chaining values of one piece */
+} tree_t;
+
+
+static void tree_init(tree_t *tree, size_t B, const uint8_t *S, size_t slen,
+		      uint8_t *cv){
+    uint8_t e[9];
+    cshake256_init(&tree->root, "ParallelHash", S, slen);
+    shake_update(&tree->root, e, left_encode(e, B));
+    tree->B = B;
+    tree->nr_leaves = 0;
+    tree->cv = cv;
+}
+
+
+/* length is a multiple of B, except for the last piece */
+static void tree_update(tree_t *tree, const uint8_t *in, size_t length){
+    size_t nr_leaves = (length + tree->B - 1) / tree->B;
+    tree_leaves(tree->cv, in, length, tree->B);
+    shake_update(&tree->root, tree->cv, nr_leaves * CV_LENGTH);
+    tree->nr_leaves += nr_leaves;
+}
+
+
+static void tree_final(tree_t *tree, uint8_t *md, size_t mdlen){
+    uint8_t e[9];
+    shake_update(&tree->root, e, right_encode(e, tree->nr_leaves));
+    shake_update(&tree->root, e, right_encode(e, 8 * (uint64_t)mdlen));
+    cshake256_final(&tree->root, md, mdlen);
+}
+
+
+int parallelhash256(uint8_t *md, size_t mdlen, const uint8_t *in, size_t len,
+		    size_t B, const uint8_t *S, size_t slen){
+    tree_t tree;
+    uint8_t *cv = malloc(((len + B - 1) / B) * CV_LENGTH + 1);
+    if(cv == NULL){
+	perror("[parallelhash256] : Not enough memory.\n");
+	return 0;
+    }
+    tree_init(&tree, B, S, slen, cv);
+    if(len > 0)
+	tree_update(&tree, in, len);
+    tree_final(&tree, md, mdlen);
+    free(cv);
+    return 1;
+}
+
+
+static int hash_tree(uint8_t *md, int out_length, const uint8_t *in, size_t len){
+    return parallelhash256(md, out_length, in, len, SHA3_TREE_BLOCK, NULL, 0);
+}
+
+
+void buffer_hash_tree(buffer_t *out, int out_length, buffer_t *in){
+    out->length = 0;
+    if(out_length <= 0 || buffer_resize(out, out_length) == 0)
+	return;
+    if(hash_tree(out->tab, out_length, in->tab, in->length))
+	out->length = out_length;
+}
+
+
+int hash_tree_to_mpz(mpz_t h, int out_length, const uint8_t *in, size_t len){
+    uint8_t md[SHA3_MAX_MDLEN];
+    if(out_length <= 0 || out_length > SHA3_MAX_MDLEN){
+	perror("[hash_tree_to_mpz] : Digest length out of range.\n");
+	return 0;
+    }
+    if(!hash_tree(md, out_length, in, len))
+	return 0;
+    mpz_import(h, out_length, 1, 1, 1, 0, md);
+    return 1;
+}
+
+
+int buffer_hash_tree_to_mpz(mpz_t h, int out_length, buffer_t *in){
+    return hash_tree_to_mpz(h, out_length, in->tab, in->length);
+}
+
+
+/* out_length bytes of hash of the file written in md : ParallelHash256
+   if tree, SHA3 otherwise */
+static int file_digest(uint8_t *md, int out_length, const char *file_name,
+		       int tree){
+    if(out_length <= 0 || (!tree && out_length > SHA3_MAX_MDLEN)){
+	perror("[file_digest] : Digest length out of range.\n");
+	return 0;
+    }
+    FILE *file = fopen(file_name, "r");
+    if(file == NULL)
+	return 0;
+
+    // 1. Pieces of whole leaves, read one after the other
+    size_t piece = (size_t)parallel_nr_threads() * SHA3_TREE_THREAD_LEAVES * SHA3_TREE_BLOCK;
+    if(piece < SHA3_TREE_MIN_PIECE)
+	piece = SHA3_TREE_MIN_PIECE;
+    uint8_t *data = malloc(piece);
+    uint8_t *cv = tree ? malloc(piece / SHA3_TREE_BLOCK * CV_LENGTH) : NULL;
+    if(data == NULL || (tree && cv == NULL)){
+	perror("[file_digest] : Not enough memory.\n");
+	free(data);
+	free(cv);
+	fclose(file);
+	return 0;
+    }
+
+    // 2. Absorbed by the sponge or by the tree
+    sha3_ctx_t c;
+    tree_t t;
+    size_t length;
+    if(tree)
+	tree_init(&t, SHA3_TREE_BLOCK, NULL, 0, cv);
+    else
+	sha3_init(&c, out_length);
+    while((length = fread(data, 1, piece, file)) > 0){
+	if(tree)
+	    tree_update(&t, data, length);
+	else
+	    sha3_update(&c, data, length);
+	if(length < piece)
+	    break;
+    }
+    if(tree)
+	tree_final(&t, md, out_length);
+    else
+	sha3_final(md, &c);
+
+    int status = !ferror(file);
+    fclose(file);
+    free(data);
+    free(cv);
+    return status;
+}
+
+
+static int file_hash_buffer(buffer_t *out, int out_length,
+			    const char *file_name, int tree){
+    out->length = 0;
+    if(out_length <= 0 || buffer_resize(out, out_length) == 0
+       || !file_digest(out->tab, out_length, file_name, tree))
+	return 0;
+    out->length = out_length;
+    return 1;
+}
+
+
+static int file_hash_mpz(mpz_t h, int out_length, const char *file_name,
+			 int tree){
+    uint8_t md[SHA3_MAX_MDLEN];
+    if(out_length <= 0 || out_length > SHA3_MAX_MDLEN){
+	perror("[file_hash_to_mpz] : Digest length out of range.\n");
+	return 0;
+    }
+    if(!file_digest(md, out_length, file_name, tree))
+	return 0;
+    mpz_import(h, out_length, 1, 1, 1, 0, md);
+    return 1;
+}
+
+
+int file_hash(buffer_t *out, int out_length, const char *file_name){
+    return file_hash_buffer(out, out_length, file_name, 0);
+}
+
+
+int file_hash_to_mpz(mpz_t h, int out_length, const char *file_name){
+    return file_hash_mpz(h, out_length, file_name, 0);
+}
+
+
+int file_hash_tree(buffer_t *out, int out_length, const char *file_name){
+    return file_hash_buffer(out, out_length, file_name, 1);
+}
+
+
+int file_hash_tree_to_mpz(mpz_t h, int out_length, const char *file_name){
+    return file_hash_mpz(h, out_length, file_name, 1);
+}
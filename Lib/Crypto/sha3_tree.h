@@ -0,0 +1,37 @@
+#ifndef __FRS__SHA3_TREE
+
+/**************************************************************/
+/* sha3_tree.h                                                */
+/* Tree hashing of long inputs: ParallelHash256 of NIST       */
+/* SP 800-185, the leaves being hashed on several threads.    */
+/**************************************************************/
+
+#define SHA3_TREE_BLOCK 8192               /* B : bytes per leaf */
+#define SHA3_TREE_MIN_PIECE (1 << 20)      /* files are read by such pieces */
+#define SHA3_TREE_MIN_THREAD_LEAVES 16     /* below, fewer threads */
+#define SHA3_TREE_THREAD_LEAVES 128        /* leaves per thread and file read */
+
+/* The number of threads is set by parallel_set_threads() */
+
+/* mdlen bytes of ParallelHash256(in, B, 8 * mdlen, S); 0 if out of memory */
+int parallelhash256(uint8_t *md, size_t mdlen, const uint8_t *in, size_t len,
+		    size_t B, const uint8_t *S, size_t slen);
+
+/* Plain SHA3 of a file read by pieces instead of being loaded : the same
+   as buffer_hash() and buffer_hash_to_mpz() of its contents. They return
+   0 if the file cannot be read or out_length is out of range. */
+int file_hash(buffer_t *out, int out_length, const char *file_name);
+int file_hash_to_mpz(mpz_t h, int out_length, const char *file_name);
+
+/* ParallelHash256 with B = SHA3_TREE_BLOCK and S = "", whatever the
+   length : a different hash from SHA3, to be asked for explicitly. */
+void buffer_hash_tree(buffer_t *out, int out_length, buffer_t *in);
+int file_hash_tree(buffer_t *out, int out_length, const char *file_name);
+
+/* The same hash read as a big-endian integer, as sha3_to_mpz() does */
+int hash_tree_to_mpz(mpz_t h, int out_length, const uint8_t *in, size_t len);
+int buffer_hash_tree_to_mpz(mpz_t h, int out_length, buffer_t *in);
+int file_hash_tree_to_mpz(mpz_t h, int out_length, const char *file_name);
+
+#define __FRS__SHA3_TREE
+#endif
@@ -0,0 +1,111 @@
+/*! \file arena.c
+  \details Per-thread bump allocator for short-lived buffers. The chunks
+  are kept from one release to the next, so that a loop doing
+  mark / allocate / release stops calling malloc() after its first turn.
+******************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct arena_chunk_s{
+    arena_chunk_t *next;
+    size_t size, used;  /* data[0..used[ is taken */
+    unsigned char data[];
+};
+
+typedef struct{
+    arena_chunk_t *first, *current; /* chunks after current are empty */
+    int wipe;
+} arena_t;
+
+static __thread arena_t arena = {NULL, NULL, 1};
+
+/*! \brief Returns the current top of the arena of the thread. */
+arena_mark_t arena_mark(void){
+    arena_mark_t mark = {arena.current, 0};
+    if(mark.chunk != NULL)
+	mark.used = mark.chunk->used;
+    return mark;
+}
+
+/*! \brief Gives back all the memory taken since \a mark was made.
+  Buffers allocated in between must not be used anymore. */
+void arena_release(arena_mark_t mark){
+    arena_chunk_t *c = mark.chunk == NULL ? arena.first : mark.chunk;
+    size_t used = mark.chunk == NULL ? 0 : mark.used;
+    if(c == NULL)
+	return;
+    arena_chunk_t *last = arena.current;
+    arena.current = c;
+    while(1){
+	if(arena.wipe && c->used > used)
+	    memset(c->data + used, 0, c->used - used);
+	c->used = used;
+	if(c == last)
+	    break;
+	c = c->next;
+	used = 0;
+    }
+}
+
+/*! \brief Returns \a size bytes aligned on ARENA_ALIGN, taken from the
+  arena of the thread, or NULL if there is not enough memory. */
+void *arena_alloc(size_t size){
+    arena_chunk_t *c = arena.current;
+    // 1. Room left in the current chunk or in the empty ones after it
+    while(c != NULL){
+	size_t pad = (-(uintptr_t)(c->data + c->used)) & (ARENA_ALIGN - 1);
+	if(c->used + pad + size <= c->size){
+	    void *p = c->data + c->used + pad;
+	    c->used += pad + size;
+	    arena.current = c;
+	    return p;
+	}
+	if(c->next == NULL)
+	    break;
+	c = c->next;
+    }
+
+    // 2. A new chunk at the end, large enough for size
+    size_t sz = size + ARENA_ALIGN > ARENA_CHUNK_SIZE ?
+	size + ARENA_ALIGN : ARENA_CHUNK_SIZE;
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + sz);
+    if(chunk == NULL){
+	perror("[arena_alloc] : Not enough memory.\n");
+	return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = sz;
+    chunk->used = 0;
+    if(c == NULL)
+	arena.first = chunk;
+    else
+	c->next = chunk;
+    arena.current = chunk;
+    return arena_alloc(size);
+}
+
+/*! \brief wipe = 1 (the default) : released memory is zeroed, once,
+  by arena_release(). wipe = 0 : it is left as is. */
+void arena_set_wipe(int wipe){
+    arena.wipe = wipe;
+}
+
+/*! \brief Frees all the chunks of the thread; nothing taken from the
+  arena may be in use. A thread using the arena should call it before
+  exiting. */
+void arena_free(void){
+    arena_chunk_t *c = arena.first, *next;
+    for(; c != NULL; c = next){
+	next = c->next;
+	if(arena.wipe)
+	    memset(c->data, 0, c->used);
+	free(c);
+    }
+    arena.first = NULL;
+    arena.current = NULL;
+}
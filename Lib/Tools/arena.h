@@ -0,0 +1,28 @@
+#ifndef __FRS__ARENA
+
+/*! \file arena.h
+ */
+
+/********** scratch arena **********/
+/* Each thread owns a stack of chunks from which temporaries are bumped.
+   arena_mark() remembers the top, arena_release() gives back everything
+   taken since, wiping it first unless arena_set_wipe(0) was called. */
+
+#define ARENA_CHUNK_SIZE (1 << 16)
+#define ARENA_ALIGN 16
+
+typedef struct arena_chunk_s arena_chunk_t;
+
+typedef struct{
+    arena_chunk_t *chunk;
+    size_t used;
+} arena_mark_t;
+
+arena_mark_t arena_mark(void);
+void arena_release(arena_mark_t mark);
+void *arena_alloc(size_t size);
+void arena_set_wipe(int wipe);
+void arena_free(void);
+
+#define __FRS__ARENA
+#endif
@@ -9,6 +9,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include "gmp.h"
 #include "buffer.h"
 #include "bits.h"
@@ -90,41 +92,26 @@ void buffer_flip_bit(buffer_t *out, buffer_t *in, int position){
        position should be less than 8 * in->length */
 
     buffer_reset(out);
-    if(position < 0 || position > BYTE_SIZE * in->length){
+    if(position < 0 || position >= BYTE_SIZE * in->length){
 	perror("[buffer_flip_bit] : Position should be in range [0, 8 * in->length[\n");
 	return;
     }
-    int byte_position = position / BYTE_SIZE;
-    int bit_position = position % BYTE_SIZE, i;
-    uchar *cursor = in->tab;
-    for(i = 0; i < in->length; i++, cursor++){
-	if(i == byte_position){
-	    uchar a = setBit(*cursor, bit_position,
-			     getBit(*cursor, bit_position) ? 0 : 1);
-	    buffer_append_uchar(out, a);
-	}
-	else
-	    buffer_append_uchar(out, *cursor);
-    }
+    if(buffer_set_length(out, in->length) == 0)
+	return;
+    memcpy(out->tab, in->tab, in->length);
+    out->tab[position / BYTE_SIZE] ^= 1 << (position % BYTE_SIZE);
 }
 
 
 int HammingWeightByte(uchar c){
-    int result = 0, j;
-    for(j = 0; j < BYTE_SIZE; j++){
-	if((c >> j) % 2 == 1)
-	    result++;
-    }
-    return result;
+    c = c - ((c >> 1) & 0x55);
+    c = (c & 0x33) + ((c >> 2) & 0x33);
+    return (c + (c >> 4)) & 0x0f;
 }
 
 
 int HammingWeight(buffer_t *buf){
-    int result = 0, i;
-    uchar *cursor = buf->tab;
-    for(i = 0; i < buf->length; i++, cursor++)
-	result += HammingWeightByte(*cursor);
-    return result;
+    return (int)HammingWeightBytes(buf->tab, buf->length);
 }
 
 
@@ -133,23 +120,177 @@ int HammingDistance(buffer_t *buf, buffer_t *buf2){
 	perror("[HammingDistance] ERROR : buffers should have the same length\n");
 	return 0;
     }
-    int result = 0, i;
-    uchar *cursor = buf->tab;
-    uchar *cursor2 = buf2->tab;
-    for(i = 0; i < buf->length; i++, cursor++, cursor2++)
-	result += HammingWeightByte(*cursor ^ *cursor2);
-    return result;
+    return (int)HammingDistanceBytes(buf->tab, buf2->tab, buf->length);
 }
 
 
 
 void oneTimePad(buffer_t *encrypted, buffer_t *msg, buffer_t *key) {
     buffer_reset(encrypted);
+    if(buffer_set_length(encrypted, msg->length) == 0)
+	return;
+    xorBytes(encrypted->tab, msg->tab, key->tab, msg->length);
+}
 
-    uchar *cursor_key = key->tab;
-    uchar *cursor_msg = msg->tab;
-    int i;
-	
-    for(i = 0; i < msg->length; i++)
-	buffer_append_uchar(encrypted, *(cursor_msg++) ^ *(cursor_key++));
+
+/********************/
+/* Wide kernels     */
+/********************/
+
+/* In each engine, weight_*(a, NULL, n) is the weight of a[0..n[ and
+   weight_*(a, b, n) the one of a[0..n[ xor b[0..n[ */
+
+static uint64_t load64(const uchar *p){
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+
+static int popcount64(uint64_t x){
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+
+static void xor_words(uchar *out, const uchar *a, const uchar *b, size_t length){
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+	uint64_t x = load64(a + i) ^ load64(b + i);
+	memcpy(out + i, &x, 8);
+    }
+    for(; i < length; i++)
+	out[i] = a[i] ^ b[i];
+}
+
+
+static size_t weight_words(const uchar *a, const uchar *b, size_t length){
+    size_t i = 0, w = 0;
+    for(; i + 8 <= length; i += 8)
+	w += popcount64(load64(a + i) ^ (b == NULL ? 0 : load64(b + i)));
+    for(; i < length; i++)
+	w += HammingWeightByte(a[i] ^ (b == NULL ? 0 : b[i]));
+    return w;
+}
+
+#if BITS_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+
+static size_t weight_popcnt(const uchar *a, const uchar *b, size_t length){
+    size_t i = 0, w = 0;
+    if(b == NULL)
+	for(; i + 8 <= length; i += 8)
+	    w += __builtin_popcountll(load64(a + i));
+    else
+	for(; i + 8 <= length; i += 8)
+	    w += __builtin_popcountll(load64(a + i) ^ load64(b + i));
+    for(; i < length; i++)
+	w += HammingWeightByte(a[i] ^ (b == NULL ? 0 : b[i]));
+    return w;
+}
+
+#pragma GCC pop_options
+
+
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+#include <immintrin.h>
+
+static void xor_avx2(uchar *out, const uchar *a, const uchar *b, size_t length){
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32){
+	__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+				     _mm256_loadu_si256((const __m256i *)(b + i)));
+	_mm256_storeu_si256((__m256i *)(out + i), x);
+    }
+    xor_words(out + i, a + i, b + i, length - i);
+}
+
+
+/* Weight of each byte by two lookups (vpshufb) of its nibbles, summed
+   on 64-bit lanes by vpsadbw */
+static size_t weight_avx2(const uchar *a, const uchar *b, size_t length){
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i sum = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32){
+	__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+	if(b != NULL)
+	    x = _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i *)(b + i)));
+	__m256i c = _mm256_add_epi8(
+	    _mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+	    _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+	sum = _mm256_add_epi64(sum, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+	+ weight_popcnt(a + i, b == NULL ? NULL : b + i, length - i);
+}
+
+#pragma GCC pop_options
+
+#endif
+
+
+/* 2 : AVX2, 1 : popcnt, 0 : 64-bit words */
+static int bits_level(void){
+    static int level = -1;
+    if(level < 0){
+#if BITS_SIMD
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+	    level = 2;
+	else
+	    level = __builtin_cpu_supports("popcnt") != 0;
+#else
+	level = 0;
+#endif
+    }
+    return level;
+}
+
+
+static size_t weight_bytes(const uchar *a, const uchar *b, size_t length){
+#if BITS_SIMD
+    switch(bits_level()){
+    case 2:
+	return weight_avx2(a, b, length);
+    case 1:
+	return weight_popcnt(a, b, length);
+    }
+#endif
+    return weight_words(a, b, length);
+}
+
+
+void xorBytes(uchar *out, const uchar *a, const uchar *b, size_t length){
+#if BITS_SIMD
+    if(bits_level() == 2){
+	xor_avx2(out, a, b, length);
+	return;
+    }
+#endif
+    xor_words(out, a, b, length);
+}
+
+
+size_t HammingWeightBytes(const uchar *a, size_t length){
+    return weight_bytes(a, NULL, length);
+}
+
+
+size_t HammingDistanceBytes(const uchar *a, const uchar *b, size_t length){
+    return weight_bytes(a, b, length);
+}
+
+
+const char *bits_engine(void){
+    static const char *names[] = {"64-bit words", "popcnt", "AVX2"};
+    return names[bits_level()];
 }
@@ -13,6 +13,15 @@
 typedef unsigned char uchar;
 typedef unsigned int uint;
 
+/* Set BITS_SIMD to 0 to build without the vector code */
+#ifndef BITS_SIMD
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BITS_SIMD 1
+#else
+#define BITS_SIMD 0
+#endif
+#endif
+
 /* Functions */
 void printDec(uchar* u, int length);
 void printHexa(uchar* u, int length);
@@ -25,5 +34,12 @@ int HammingWeight(buffer_t *buf);
 int HammingDistance(buffer_t *buf, buffer_t *buf2);
 void oneTimePad(buffer_t *encrypted, buffer_t *msg, buffer_t *key);
 
+/* Same on arrays of length bytes : out = a xor b, weight of a, weight
+   of a xor b. AVX2, popcnt or 64-bit words, chosen at run time. */
+void xorBytes(uchar *out, const uchar *a, const uchar *b, size_t length);
+size_t HammingWeightBytes(const uchar *a, size_t length);
+size_t HammingDistanceBytes(const uchar *a, const uchar *b, size_t length);
+const char *bits_engine(void);
+
 #define __FRS__BITS
 #endif
@@ -7,16 +7,29 @@
   performed, its size may be increased.
 ******************************************************************/
 
+#define _POSIX_C_SOURCE 200809L // for fileno() and mmap()
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define HAVE_MMAP 1
+#else
+#define HAVE_MMAP 0
+#endif
+
 #include "gmp.h"
 #include "utilities.h"
 #include "random.h"
 #include "base64.h"
 #include "buffer.h"
+#include "arena.h"
 
 /*! \def DEBUG
   \brief set DEBUG to 1 to have a complete equality test 
@@ -28,13 +41,42 @@ int buffer_init(buffer_t *buf, size_t size){
     if(size == 0) size = 1;
     buf->size = size;
     buf->length = 0;
+    buf->origin = BUFFER_HEAP;
     buf->tab = (uchar *)malloc(size * sizeof(uchar));
     return buf->tab != NULL;
 }
 
+/*! \brief initialize \a buf as an array of maximal size \a size taken
+  from the scratch arena of the thread. It is used as any other buffer,
+  but its memory is only given back (and wiped) by arena_release(). */
+int buffer_init_scratch(buffer_t *buf, size_t size){
+    if(size == 0) size = 1;
+    buf->origin = BUFFER_SCRATCH;
+    buf->length = 0;
+    buf->tab = (uchar *)arena_alloc(size);
+    buf->size = buf->tab == NULL ? 0 : size;
+    return buf->tab != NULL;
+}
+
 /*! \brief Clears and frees the memory occuped by the buffer */
 void buffer_clear(buffer_t *buf){
-    memset(buf->tab, 0, buf->size);
+    if(buf->origin == BUFFER_SCRATCH){
+	buf->tab = NULL;
+	buf->size = -1;
+	buf->length = 0;
+	return;
+    }
+#if HAVE_MMAP
+    if(buf->origin == BUFFER_MAPPED){
+	munmap(buf->tab, buf->size);
+	buf->origin = BUFFER_HEAP;
+	buf->tab = NULL;
+	buf->size = -1;
+	buf->length = 0;
+	return;
+    }
+#endif
+    buffer_wipe(buf);
     free((char *)buf->tab);
     buf->tab = NULL;
     buf->size = -1;
@@ -68,7 +110,22 @@ int buffer_print_int(FILE *ofile, buffer_t *buf){
 int buffer_resize(buffer_t *buf, size_t len){
     /* Changes the size of the table contained in buf */
     if(buf->size < len){
-	if((buf->tab = realloc(buf->tab, len)) == NULL)
+	if(buf->origin != BUFFER_HEAP){
+	    // A scratch buffer moves within the arena, a mapped one to the heap
+	    uchar *tab = (uchar *)(buf->origin == BUFFER_SCRATCH ?
+				   arena_alloc(len) : malloc(len));
+	    if(tab == NULL)
+		return 0;
+	    memcpy(tab, buf->tab, buf->size);
+#if HAVE_MMAP
+	    if(buf->origin == BUFFER_MAPPED){
+		munmap(buf->tab, buf->size);
+		buf->origin = BUFFER_HEAP;
+	    }
+#endif
+	    buf->tab = tab;
+	}
+	else if((buf->tab = realloc(buf->tab, len)) == NULL)
 	    return 0;
 	buf->size = len;
     }
@@ -76,32 +133,64 @@ int buffer_resize(buffer_t *buf, size_t len){
 }
 
 
+/*! \brief Makes room for \a size bytes in \a buf. The size is at
+  least doubled when it grows, so that repeated appends stay linear. */
+int buffer_reserve(buffer_t *buf, size_t size){
+    if(size <= buf->size)
+	return 1;
+    size_t sz = 2 * buf->size;
+    return buffer_resize(buf, sz > size ? sz : size);
+}
+
+/*! \brief Sets the length of \a buf, resizing it if needed. The bytes
+  beyond the former length are not initialized : they are meant to be
+  written directly in \a buf->tab. */
+int buffer_set_length(buffer_t *buf, size_t length){
+    if(buffer_reserve(buf, length) == 0)
+	return 0;
+    buf->length = length;
+    return 1;
+}
+
+/*! \brief Appends \a length bytes at the end of \a buf. */
+int buffer_append_bytes(buffer_t *buf, const uchar *bytes, size_t length){
+    if(buffer_reserve(buf, buf->length + length) == 0)
+	return 0;
+    if(length > 0)
+	memcpy(buf->tab + buf->length, bytes, length);
+    buf->length += length;
+    return 1;
+}
+
+/*! \brief View on \a buf->tab[start..start+length[, cut at the end
+  of \a buf. No copy is made : the view lasts as long as \a buf is
+  neither resized nor cleared. */
+buffer_view_t buffer_view(buffer_t *buf, size_t start, size_t length){
+    buffer_view_t view = {buf->tab, 0};
+    if(start > buf->length)
+	start = buf->length;
+    if(length > buf->length - start)
+	length = buf->length - start;
+    view.tab = buf->tab + start;
+    view.length = length;
+    return view;
+}
+
+/*! \brief Appends the bytes seen by \a view at the end of \a buf,
+  which should not be the buffer seen. */
+int buffer_append_view(buffer_t *buf, buffer_view_t view){
+    return buffer_append_bytes(buf, view.tab, view.length);
+}
+
 /*! \brief Appends the contents of next at the end of the contents
   of buf. If buf is too small, it is resized. */
 int buffer_append(buffer_t *buf, buffer_t *next){
-    size_t len = buf->length + next->length;
-    if(len > buf->size){
-	size_t sz = buf->size;
-	if(sz == 0)
-	    sz = 1;
-	while(sz < len)
-	    sz = 2*sz;
-	len = sz;
-    }
-	
-    if(buffer_resize(buf, len) == 0)
-	return 0;
-    memcpy(buf->tab+buf->length, next->tab, next->length);
-    buf->length += next->length;
-    return 1;
+    return buffer_append_bytes(buf, next->tab, next->length);
 }
 
 /*! \brief Appends an element at the end of the buffer */
 int buffer_append_uchar(buffer_t *buf, uchar c){
-    size_t len = buf->length + 1;
-    if(len > buf->size)
-	len = 2 * buf->size;
-    if(buffer_resize(buf, len) == 0)
+    if(buffer_reserve(buf, buf->length + 1) == 0)
 	return 0;
     buf->tab[buf->length] = c;
     buf->length += 1;
@@ -109,12 +198,22 @@ int buffer_append_uchar(buffer_t *buf, uchar c){
 }
 
 
-/*! \brief Reset buffer to 0 */
+/*! \brief Reset buffer to 0. Only the bytes in use are cleared, so that
+  the cost does not depend on how large \a buf once grew. */
 void buffer_reset(buffer_t *buf){
-    memset(buf->tab, 0, buf->size);
+    if(buf->length > 0)
+	memset(buf->tab, 0, buf->length);
     buf->length = 0;	
 }
 
+/*! \brief Reset buffer to 0 on its whole size : for buffers that held
+  secrets, whatever their current length is. */
+void buffer_wipe(buffer_t *buf){
+    if(buf->tab != NULL && buf->size > 0)
+	memset(buf->tab, 0, buf->size);
+    buf->length = 0;
+}
+
 
 /*! \brief Return 1 if \a buf1 == \a buf2 (same length, same content). */
 int buffer_equality(buffer_t *buf1, buffer_t *buf2){
@@ -182,24 +281,57 @@ int buffer_from_file(buffer_t *buf, const char *file_name){
     FILE *file = fopen(file_name, "r");
     if(file == NULL)
 	return 0;
-    while(1){
-	char c = fgetc(file);
-	if(feof(file))
-	    break;
-	buffer_append_uchar(buf, c);
+    size_t n;
+#if HAVE_MMAP
+    // A regular file is read at once
+    struct stat st;
+    if(fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)
+       && buffer_reserve(buf, (size_t)st.st_size + 1) == 0){
+	fclose(file);
+	return 0;
     }
+#endif
+    do{
+	if(buf->length == buf->size
+	   && buffer_reserve(buf, buf->length + BUFSIZ) == 0){
+	    fclose(file);
+	    return 0;
+	}
+	n = fread(buf->tab + buf->length, 1, buf->size - buf->length, file);
+	buf->length += n;
+    } while(n > 0);
     fclose(file);
     return 1;	
 }
 
-/*! \brief Fills in a buffer with \a byte_length random bytes
-  Pseudo-random generator should have been intialised before
-*/
-void buffer_random(buffer_t *out, int byte_length){
-    int i;
-    buffer_reset(out);
-    for(i = 0; i < byte_length; i++)
-	buffer_append_uchar(out, (uchar)rand());
+/*! \brief Initializes \a buf with the contents of \a file without copying
+  them : the file is mapped in memory, privately, so that writing in
+  \a buf does not change the file. If the file cannot be mapped (empty
+  file, pipe, ...), it is read as by buffer_from_file(). Returns 0 if
+  the file cannot be read; \a buf is to be freed by buffer_clear() in
+  any case. */
+int buffer_map_file(buffer_t *buf, const char *file_name){
+#if HAVE_MMAP
+    int fd = open(file_name, O_RDONLY);
+    struct stat st;
+    if(fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+	void *tab = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE, fd, 0);
+	if(tab != MAP_FAILED){
+	    close(fd);
+	    posix_madvise(tab, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+	    buf->tab = (uchar *)tab;
+	    buf->size = buf->length = (size_t)st.st_size;
+	    buf->origin = BUFFER_MAPPED;
+	    return 1;
+	}
+    }
+    if(fd >= 0)
+	close(fd);
+#endif
+    if(buffer_init(buf, BUFSIZ) == 0)
+	return 0;
+    return buffer_from_file(buf, file_name);
 }
 
 /* out will have a length which is = 0 mod 3. */
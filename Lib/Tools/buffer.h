@@ -9,23 +9,42 @@ typedef unsigned char uchar;
 typedef struct{
     uchar *tab; /* tab[0..length[ */
     size_t size, length; /* 0 <= length <= size */
+    int origin;          /* where tab comes from, see below */
 } buffer_t;
 
+#define BUFFER_HEAP 0    /* malloc()ed by buffer_init() */
+#define BUFFER_SCRATCH 1 /* taken from the arena of the thread */
+#define BUFFER_MAPPED 2  /* private mapping of a file */
+
+/* Slice of memory owned by someone else (a buffer, a stack array) :
+   it is never resized nor freed */
+typedef struct{
+    uchar *tab; /* tab[0..length[ */
+    size_t length;
+} buffer_view_t;
+
 int buffer_init(buffer_t *buf, size_t size);
+int buffer_init_scratch(buffer_t *buf, size_t size);
 void buffer_clear(buffer_t *buf);
 int buffer_print(FILE *ofile, buffer_t *buf);
 int buffer_print_int(FILE *ofile, buffer_t *buf);
 int buffer_resize(buffer_t *buf, size_t len);
 int buffer_append(buffer_t *buf, buffer_t *next);
 int buffer_append_uchar(buffer_t *buf, uchar c);
+int buffer_reserve(buffer_t *buf, size_t size);
+int buffer_set_length(buffer_t *buf, size_t length);
+int buffer_append_bytes(buffer_t *buf, const uchar *bytes, size_t length);
+buffer_view_t buffer_view(buffer_t *buf, size_t start, size_t length);
+int buffer_append_view(buffer_t *buf, buffer_view_t view);
 void buffer_reset(buffer_t *buf);
+void buffer_wipe(buffer_t *buf);
 int buffer_equality(buffer_t *buf1, buffer_t *buf2);
 void buffer_clone(buffer_t *out, buffer_t *in);
 
 int buffer_from_string(buffer_t *buf, uchar *str, size_t len);
 uchar *string_from_buffer(buffer_t *buf);
 int buffer_from_file(buffer_t *buf, const char *file_name);
-void buffer_random(buffer_t *out, int byte_length);
+int buffer_map_file(buffer_t *buf, const char *file_name);
 
 void buffer_to_base64(buffer_t *out, buffer_t *in);
 void buffer_from_base64(buffer_t *out, buffer_t *in);
@@ -0,0 +1,56 @@
+/*! \file parallel.c
+  \details Fan-out of independent tasks over threads. Every parallel
+  loop of the library goes through parallel_run(), so that one call to
+  parallel_set_threads() sets them all.
+******************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "parallel.h"
+
+static int parallel_threads = 0;
+
+/*! \brief Sets the number of threads used by parallel code.
+ *  \param nr_threads 0 for as many threads as online processors.
+ */
+void parallel_set_threads(int nr_threads){
+    parallel_threads = nr_threads < 0 ? 0 : nr_threads;
+}
+
+
+/*! \brief Number of threads to use, between 1 and PARALLEL_MAX_THREADS.
+ */
+int parallel_nr_threads(void){
+    long n = parallel_threads > 0 ? parallel_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int)n);
+}
+
+
+/*! \brief Calls work on each of the nr_tasks tasks of size bytes stored
+ *  one after the other from tasks, one thread per task. The calling
+ *  thread does the last one, and those whose thread could not start.
+ */
+void parallel_run(void *(*work)(void *), void *tasks, size_t size, int nr_tasks){
+    pthread_t thread[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS];
+    char *task = (char *)tasks;
+    int t, nr_started = nr_tasks - 1;
+    if(nr_started > PARALLEL_MAX_THREADS)
+	nr_started = PARALLEL_MAX_THREADS;
+
+    // 1. One thread per task, the calling thread takes what is left
+    for(t = 0; t < nr_started; t++)
+	started[t] = pthread_create(&thread[t], NULL, work, task + t * size) == 0;
+    for(t = nr_started < 0 ? 0 : nr_started; t < nr_tasks; t++)
+	work(task + t * size);
+
+    // 2. Wait for the others, do their work if they could not start
+    for(t = 0; t < nr_started; t++){
+	if(started[t])
+	    pthread_join(thread[t], NULL);
+	else
+	    work(task + t * size);
+    }
+}
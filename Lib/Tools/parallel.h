@@ -0,0 +1,20 @@
+#ifndef __FRS__PARALLEL
+
+/*! \file parallel.h
+ */
+
+/********** parallel for **********/
+/* One setting for the whole library : the number of threads used by the
+   code that cuts its work into independent tasks (CBC decryption, CTR,
+   tree hashing, ...). */
+
+#include <stddef.h>
+
+#define PARALLEL_MAX_THREADS 64
+
+void parallel_set_threads(int nr_threads);
+int parallel_nr_threads(void);
+void parallel_run(void *(*work)(void *), void *tasks, size_t size, int nr_tasks);
+
+#define __FRS__PARALLEL
+#endif
@@ -4,30 +4,50 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
+
+#if defined(__linux__) && defined(__GLIBC__)			\
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#include <sys/random.h>
+#define HAVE_GETRANDOM 1
+#else
+#define HAVE_GETRANDOM 0
+#endif
 
 #include "random.h"
 
-/*! \brief returns a random seed as random as it can be. */
-unsigned int random_seed(){
-    FILE* f;
-    f = fopen("/dev/urandom", "r");
-    if(f == NULL){
-	perror("Your system has no /dev/urandom file. Please find another source of physical randomness");
-	return time(NULL);
-    }
-		
-    unsigned int result = 0;
-    int i = 0;
-    while(i < 4){
-	unsigned char c = fgetc(f);
-	if(feof(f)){
-	    printf("EOF : Should close and re-open /dev/urandom\n\n");
-	    fclose(f);
-	    f = fopen("/dev/urandom", "r");
+/*! \brief Fills in \a out with \a len bytes of the system generator,
+  getrandom() if available, /dev/urandom otherwise.
+  Returns 1 on success, 0 otherwise. */
+int random_entropy(void *out, size_t len){
+    unsigned char *p = (unsigned char *)out;
+#if HAVE_GETRANDOM
+    while(len > 0){
+	ssize_t n = getrandom(p, len, 0);
+	if(n < 0){
+	    if(errno == EINTR)
+		continue;
+	    break;
 	}
-	else
-	    result += ((unsigned int)c) << (8 * i++);
+	p += n;
+	len -= n;
     }
+    if(len == 0)
+	return 1;
+#endif
+    FILE* f = fopen("/dev/urandom", "r");
+    if(f == NULL)
+	return 0;
+    size_t n = fread(p, 1, len, f);
     fclose(f);
-    return result;
+    return n == len;
+}
+
+/*! \brief returns a random seed as random as it can be. */
+unsigned int random_seed(){
+    unsigned int result;
+    if(random_entropy(&result, sizeof(result)))
+	return result;
+    perror("Your system has no getrandom() nor /dev/urandom. Please find another source of physical randomness");
+    return time(NULL);
 }
@@ -3,6 +3,7 @@
 /*! \file random.h
  */
 
+int random_entropy(void *out, size_t len);
 unsigned int random_seed();
 
 #define __FRS__RANDOM
@@ -1,5 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "utilities.h"
 
@@ -12,3 +16,10 @@ void implementation_check(const char *fctname, int n){
     }
 }
 
+unsigned long long ticks(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long)clock();
+#endif
+}
@@ -3,3 +3,6 @@
 #define NOT_YET_IMPLEMENTED -42
 
 void implementation_check(const char *fctname, int n);
+
+/* Cycle counter if any, processor time otherwise : for differences only */
+unsigned long long ticks(void);